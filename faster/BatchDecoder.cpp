@@ -0,0 +1,265 @@
+#include <batch_decoder.h>
+#include <coefficients.h>
+
+#include "DecodeWithReader.h"
+#include "JPEG_Reader.h"
+#include "Trace.h"
+#include "WorkStealingPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+
+namespace {
+size_t McuHeight(const JpegInfo& info) {
+    size_t mcu_height = 0;
+    for (const JpegComponentInfo& component : info.components) {
+        mcu_height = std::max<size_t>(mcu_height, 8 * component.vertical);
+    }
+    return mcu_height;
+}
+
+// Bands are made of whole MCU rows, there are a few bands per worker so that
+// the idle ones have something to steal.
+size_t BandRows(size_t mcu_rows, size_t threads) {
+    return std::max<size_t>(1, mcu_rows / (4 * threads));
+}
+
+struct Job {
+    // Whether the image may be reconstructed by several workers.
+    bool allow_split = true;
+    // Estimated peak memory taken by the image.
+    size_t memory = 0;
+};
+
+// Large image that is reconstructed by bands on several workers.
+struct SplitImage {
+    SplitImage(JpegCoefficients coefficients, DecodeRegion in_roi, size_t bands, size_t in_memory)
+        : decoded(std::move(coefficients)), roi(in_roi), bands_left(bands), memory(in_memory) {
+        image.SetSize(roi.width, roi.height);
+        image.SetComment(decoded.GetInfo().comment);
+    }
+
+    DecodedCoefficients decoded;
+    DecodeRegion roi;
+    Image image{};
+    std::atomic<size_t> bands_left;
+    size_t memory;
+    std::mutex error_mutex{};
+    std::exception_ptr error{};
+};
+
+class BatchRunner {
+public:
+    BatchRunner(const DecodeOptions& options, const BatchCallback& callback,
+                const BatchOptions& batch_options)
+        : options_(options), callback_(callback), batch_options_(batch_options),
+          pool_(batch_options.threads) {
+    }
+
+    void Run(const std::vector<std::istream*>& inputs) {
+        for (size_t i = 0; i < inputs.size(); ++i) {
+            Job job;
+            if (batch_options_.memory_budget) {
+                job = Plan(*inputs[i]);
+                Admit(job.memory);
+            }
+            pool_.Submit([this, i, input = inputs[i], job] { DecodeFile(i, *input, job); });
+        }
+        pool_.Wait();
+        if (callback_error_) {
+            std::rethrow_exception(callback_error_);
+        }
+    }
+
+private:
+    // Estimates the memory from the headers and chooses the way of decoding
+    // which fits into the budget left.
+    Job Plan(std::istream& input) {
+        std::streampos position = input.tellg();
+        if (position == std::streampos(-1)) {
+            throw std::invalid_argument("Inputs have to be seekable for the memory budget");
+        }
+        JpegInfo info;
+        {
+            JpegReader reader(input);
+            reader.SetLimits(options_.limits);
+            // Otherwise the error is reported when the image is decoded.
+            if (reader.ReadHeaders()) {
+                info = reader.GetInfo();
+            }
+        }
+        input.clear();
+        input.seekg(position);
+        if (info.components.empty()) {
+            return {false, 0};
+        }
+
+        DecodeRegion roi{};
+        try {
+            roi = ClipRegion(options_.roi, info.width, info.height);
+        } catch (const std::exception&) {
+            return {false, 0};
+        }
+        Job sequential{false, EstimateDecodeMemory(info, roi).Sequential()};
+        if (options_.allow_partial || info.width * info.height <= batch_options_.split_pixels) {
+            return sequential;
+        }
+        Job split{true, SplitMemory(info, roi)};
+
+        std::lock_guard lock(memory_mutex_);
+        return used_memory_ + split.memory <= batch_options_.memory_budget ? split : sequential;
+    }
+
+    // The image, the coefficients and the band every worker may hold before
+    // copying it into the image.
+    size_t SplitMemory(const JpegInfo& info, DecodeRegion roi) const {
+        DecodeMemory memory = EstimateDecodeMemory(info, roi);
+        size_t mcu_height = McuHeight(info);
+        size_t mcu_rows = (info.height + mcu_height - 1) / mcu_height;
+        size_t threads = pool_.ThreadsCount();
+        return memory.image + memory.coefficients +
+               threads * BandRows(mcu_rows, threads) * memory.band;
+    }
+
+    void Admit(size_t memory) {
+        std::unique_lock lock(memory_mutex_);
+        memory_freed_.wait(lock, [this, memory] {
+            return used_memory_ == 0 || used_memory_ + memory <= batch_options_.memory_budget;
+        });
+        used_memory_ += memory;
+    }
+
+    void Release(size_t memory) {
+        {
+            std::lock_guard lock(memory_mutex_);
+            used_memory_ -= memory;
+        }
+        memory_freed_.notify_all();
+    }
+
+    void DecodeFile(size_t index, std::istream& input, Job job) {
+        TRACE_SPAN("file");
+        BatchResult result;
+        result.index = index;
+        try {
+            JpegReader& reader = GetThreadReader(input);
+            reader.SetTables(options_.tables);
+            reader.SetLimits(options_.limits);
+            if (!reader.ReadHeaders()) {
+                ThrowDecodeError(reader.GetError());
+            }
+
+            const JpegInfo& info = reader.GetInfo();
+            // Partial images need the rows decoded before the error, which
+            // only the sequential decoding gives.
+            if (!job.allow_split || options_.allow_partial ||
+                info.width * info.height <= batch_options_.split_pixels) {
+                if (!reader.ReadSOS(result.image, options_, &result.status)) {
+                    ThrowDecodeError(reader.GetError());
+                }
+            } else {
+                DecodeRegion roi = ClipRegion(options_.roi, info.width, info.height);
+                // The image and the bands are allocated after the
+                // coefficients, so they are checked together up front.
+                if (!reader.CheckLimits(SplitMemory(info, roi))) {
+                    ThrowDecodeError(reader.GetError());
+                }
+                JpegCoefficients coefficients;
+                if (!reader.ReadCoefficients(coefficients)) {
+                    ThrowDecodeError(reader.GetError());
+                }
+                Split(index, std::move(coefficients), roi, job.memory);
+                return;
+            }
+        } catch (...) {
+            result.image = Image();
+            result.error = std::current_exception();
+        }
+        Report(std::move(result), job.memory);
+    }
+
+    void Split(size_t index, JpegCoefficients coefficients, DecodeRegion roi, size_t memory) {
+        size_t mcu_height = McuHeight(coefficients.info);
+        size_t first_row = roi.y / mcu_height;
+        size_t last_row = (roi.y + roi.height - 1) / mcu_height;
+        size_t rows = last_row - first_row + 1;
+        size_t rows_per_band = BandRows(rows, pool_.ThreadsCount());
+        size_t bands = (rows + rows_per_band - 1) / rows_per_band;
+
+        auto split =
+            std::make_shared<SplitImage>(std::move(coefficients), roi, bands, memory);
+        for (size_t band = 0; band < bands; ++band) {
+            size_t y_begin = std::max(roi.y, (first_row + band * rows_per_band) * mcu_height);
+            size_t y_end = std::min(roi.y + roi.height,
+                                    (first_row + (band + 1) * rows_per_band) * mcu_height);
+            pool_.Submit([this, index, split, y_begin, y_end] {
+                RenderBand(index, *split, y_begin, y_end);
+            });
+        }
+    }
+
+    void RenderBand(size_t index, SplitImage& split, size_t y_begin, size_t y_end) {
+        TRACE_SPAN("band");
+        try {
+            Image band = split.decoded.Render(
+                1, PixelFormat::kRgb, {split.roi.x, y_begin, split.roi.width, y_end - y_begin});
+            for (size_t y = y_begin; y < y_end; ++y) {
+                for (size_t x = 0; x < split.roi.width; ++x) {
+                    split.image.SetPixel(y - split.roi.y, x, band.GetPixel(y - y_begin, x));
+                }
+            }
+        } catch (...) {
+            std::lock_guard lock(split.error_mutex);
+            if (!split.error) {
+                split.error = std::current_exception();
+            }
+        }
+
+        if (--split.bands_left == 0) {
+            BatchResult result;
+            result.index = index;
+            if (split.error) {
+                result.error = split.error;
+            } else {
+                result.image = std::move(split.image);
+                result.status.rows_decoded = split.roi.height;
+            }
+            Report(std::move(result), split.memory);
+        }
+    }
+
+    // The tasks of the pool must not throw, so the first exception of the
+    // callback is kept until the batch is done.
+    void Report(BatchResult result, size_t memory) {
+        {
+            std::lock_guard lock(callback_mutex_);
+            try {
+                callback_(std::move(result));
+            } catch (...) {
+                if (!callback_error_) {
+                    callback_error_ = std::current_exception();
+                }
+            }
+        }
+        Release(memory);
+    }
+
+    const DecodeOptions& options_;
+    const BatchCallback& callback_;
+    const BatchOptions& batch_options_;
+    std::mutex callback_mutex_{};
+    std::exception_ptr callback_error_{};
+    std::mutex memory_mutex_{};
+    std::condition_variable memory_freed_{};
+    size_t used_memory_ = 0;
+    WorkStealingPool pool_;
+};
+}  // namespace
+
+void DecodeBatch(const std::vector<std::istream*>& inputs, const DecodeOptions& options,
+                 const BatchCallback& callback, const BatchOptions& batch_options) {
+    BatchRunner runner(options, callback, batch_options);
+    runner.Run(inputs);
+}
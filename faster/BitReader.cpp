@@ -1,20 +1,34 @@
 #include "BitReader.h"
 
-BitReader::BitReader(std::istream& istream) : istream_(istream), current_bit_(8) {
-    current_byte_ = istream_.get();
-    if (istream.eof()) {
-        throw std::invalid_argument("Invalid istream on input");
+BitReader::BitReader(std::istream& istream) {
+    Reset(istream);
+}
+
+void BitReader::Reset(std::istream& istream) {
+    istream_ = &istream;
+    bytes_read_ = 0;
+    ended_ = false;
+    current_bit_ = 8;
+    current_byte_ = ReadByte();
+}
+
+uint8_t BitReader::ReadByte() {
+    // Same as istream::get, but without building a sentry for every byte.
+    int byte = istream_->rdbuf()->sbumpc();
+    if (byte == std::char_traits<char>::eof()) {
+        istream_->setstate(std::ios_base::eofbit | std::ios_base::failbit);
+        ended_ = true;
+        return 0;
     }
+    ++bytes_read_;
+    return byte;
 }
 
 bool BitReader::GetNextBit(bool skip_ff) {
     if (current_bit_ == 0) {
-        current_byte_ = istream_.get();
-        if (istream_.eof()) {
-            throw std::runtime_error("Cannot read next byte");
-        }
+        current_byte_ = ReadByte();
         if (skip_ff && current_byte_ == 0xFF) {
-            istream_.get();
+            ReadByte();
         }
         current_bit_ = 8;
     }
@@ -26,12 +40,9 @@ bool BitReader::GetNextBit(bool skip_ff) {
 
 uint8_t BitReader::GetNextByte(bool skip_ff) {
     if (current_bit_ == 0) {
-        current_byte_ = istream_.get();
-        if (istream_.eof()) {
-            throw std::runtime_error("Cannot read next byte");
-        }
+        current_byte_ = ReadByte();
         if (skip_ff && current_byte_ == 0xFF) {
-            istream_.get();
+            ReadByte();
         }
         return current_byte_;
     }
@@ -41,19 +52,17 @@ uint8_t BitReader::GetNextByte(bool skip_ff) {
         return current_byte_;
     }
 
-    throw std::invalid_argument("Current byte was not read fully");
+    throw std::logic_error("Current byte was not read fully");
 }
 
 uint16_t BitReader::PeekNextBytes() {
     uint16_t res = 0;
     uint8_t first_byte = 0;
     uint8_t second_byte = 0;
+    size_t bytes_read = bytes_read_;
 
     if (current_bit_ < 8) {
-        first_byte = istream_.get();
-        if (istream_.eof()) {
-            throw std::runtime_error("Cannot read next byte");
-        }
+        first_byte = ReadByte();
     } else {
         first_byte = current_byte_;
     }
@@ -61,17 +70,54 @@ uint16_t BitReader::PeekNextBytes() {
     res += first_byte;
     res <<= 8;
 
-    second_byte = istream_.get();
-    if (istream_.eof()) {
-        throw std::runtime_error("Cannot read next byte");
+    second_byte = ReadByte();
+    if (ended_) {
+        return 0;
     }
 
     res += second_byte;
 
-    istream_.unget();
+    istream_->unget();
     if (current_bit_ < 8) {
-        istream_.unget();
+        istream_->unget();
     }
+    bytes_read_ = bytes_read;
 
     return res;
-}
\ No newline at end of file
+}
+
+void BitReader::AlignToByte() {
+    if (current_bit_ != 8) {
+        current_bit_ = 0;
+    }
+}
+
+size_t BitReader::Offset() const {
+    // The byte read ahead is not consumed until its first bit is taken.
+    return bytes_read_ - (current_bit_ == 8 && !ended_ ? 1 : 0);
+}
+
+BitReader::State BitReader::GetState() {
+    return {istream_->tellg(), current_byte_, current_bit_, bytes_read_};
+}
+
+void BitReader::SetState(const State& state) {
+    istream_->clear();
+    istream_->seekg(state.position);
+    current_byte_ = state.current_byte;
+    current_bit_ = state.current_bit;
+    bytes_read_ = state.bytes_read;
+    ended_ = false;
+}
+
+std::streamoff BitReader::BytesLeft() {
+    std::streampos position = istream_->tellg();
+    if (position == std::streampos(-1)) {
+        return -1;
+    }
+    istream_->seekg(0, std::ios_base::end);
+    std::streampos end = istream_->tellg();
+    istream_->clear();
+    istream_->seekg(position);
+    return end == std::streampos(-1) ? -1 : end - position;
+}
@@ -1,18 +1,67 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
 #include <istream>
+#include <stdexcept>
 #include <type_traits>
 
+// Thrown when the input ends earlier than expected.
+class EndOfInput : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+// Reads the input bit by bit. Once the input ends, the reader gives zero bits
+// and Ended() is set, so that the decoding loops check for the end once in a
+// while instead of on every bit.
 class BitReader {
 public:
+    struct State {
+        std::streampos position{};
+        uint8_t current_byte{};
+        size_t current_bit{};
+        size_t bytes_read{};
+    };
+
     explicit BitReader(std::istream& istream);
 
+    // Starts reading the new input.
+    void Reset(std::istream& istream);
+
     bool GetNextBit(bool skip_ff = false);
 
     uint8_t GetNextByte(bool skip_ff = false);
 
     uint16_t PeekNextBytes();
 
+    // Drops the rest of the current byte.
+    void AlignToByte();
+
+    // Whether the reader tried to read past the end of the input.
+    bool Ended() const {
+        return ended_;
+    }
+
+    // Bytes consumed from the start of the input.
+    size_t Offset() const;
+
+    // The input has to be seekable to restore the state.
+    State GetState();
+
+    void SetState(const State& state);
+
+    // Bytes from the current position to the end of the input, -1 if the
+    // input is not seekable.
+    std::streamoff BytesLeft();
+
 private:
-    std::istream& istream_;
+    // Returns the next byte of the input, or zero with Ended() set.
+    uint8_t ReadByte();
+
+    std::istream* istream_{};
     uint8_t current_byte_{};
     size_t current_bit_{};
+    size_t bytes_read_{};
+    bool ended_ = false;
 };
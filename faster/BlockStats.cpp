@@ -0,0 +1,92 @@
+#include "BlockStats.h"
+
+#include <algorithm>
+
+namespace {
+template <class Histogram>
+void PrintHistogram(std::ostream& out, const char* name, const Histogram& histogram,
+                    size_t first = 0) {
+    out << name << ":";
+    for (size_t i = first; i < histogram.size(); ++i) {
+        out << " " << histogram[i];
+    }
+    out << "\n";
+}
+}  // namespace
+
+void BlockStats::BeginScan(size_t blocks_per_mcu) {
+    blocks_per_mcu_ = std::max<size_t>(blocks_per_mcu, 1);
+    mcu_blocks_ = 0;
+    mcu_bits_ = 0;
+}
+
+void BlockStats::AddDCCode(size_t code_length, size_t value_bits) {
+    ++dc_code_lengths[code_length];
+    mcu_bits_ += code_length + value_bits;
+}
+
+void BlockStats::AddACCode(size_t code_length, uint8_t run_size) {
+    ++ac_code_lengths[code_length];
+    mcu_bits_ += code_length + (run_size & 0x0F);
+    if (run_size == 0xF0) {
+        ++zrl_codes;
+    } else if (run_size != 0) {
+        ++zero_runs[run_size >> 4];
+    }
+}
+
+void BlockStats::AddBlock(size_t eob_position) {
+    ++blocks;
+    dc_only_blocks += eob_position == 1;
+    ++eob_positions[eob_position];
+
+    if (++mcu_blocks_ < blocks_per_mcu_) {
+        return;
+    }
+    ++mcus;
+    bits += mcu_bits_;
+    size_t bucket = mcu_bits_ / kMcuBitsBucket;
+    if (mcu_bits.size() <= bucket) {
+        mcu_bits.resize(bucket + 1);
+    }
+    ++mcu_bits[bucket];
+    mcu_blocks_ = 0;
+    mcu_bits_ = 0;
+}
+
+void BlockStats::Merge(const BlockStats& other) {
+    blocks += other.blocks;
+    dc_only_blocks += other.dc_only_blocks;
+    for (size_t i = 0; i < eob_positions.size(); ++i) {
+        eob_positions[i] += other.eob_positions[i];
+    }
+    for (size_t i = 0; i < zero_runs.size(); ++i) {
+        zero_runs[i] += other.zero_runs[i];
+    }
+    zrl_codes += other.zrl_codes;
+    for (size_t i = 0; i < dc_code_lengths.size(); ++i) {
+        dc_code_lengths[i] += other.dc_code_lengths[i];
+        ac_code_lengths[i] += other.ac_code_lengths[i];
+    }
+    mcus += other.mcus;
+    bits += other.bits;
+    if (mcu_bits.size() < other.mcu_bits.size()) {
+        mcu_bits.resize(other.mcu_bits.size());
+    }
+    for (size_t i = 0; i < other.mcu_bits.size(); ++i) {
+        mcu_bits[i] += other.mcu_bits[i];
+    }
+}
+
+void BlockStats::Print(std::ostream& out) const {
+    out << "blocks: " << blocks << "\n";
+    out << "dc_only_blocks: " << dc_only_blocks << "\n";
+    PrintHistogram(out, "eob_positions", eob_positions);
+    PrintHistogram(out, "zero_runs", zero_runs);
+    out << "zrl_codes: " << zrl_codes << "\n";
+    PrintHistogram(out, "dc_code_lengths", dc_code_lengths, 1);
+    PrintHistogram(out, "ac_code_lengths", ac_code_lengths, 1);
+    out << "mcus: " << mcus << "\n";
+    out << "bits_per_mcu: " << (mcus ? static_cast<double>(bits) / mcus : 0.0) << "\n";
+    PrintHistogram(out, "mcu_bits", mcu_bits);
+}
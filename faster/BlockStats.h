@@ -0,0 +1,56 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+// Histograms of the entropy-coded blocks, collected by JpegReader when it is
+// given them. They show what the fast paths of the decoder should target.
+struct BlockStats {
+    // Bits of the MCUs are counted in buckets of this size.
+    static constexpr size_t kMcuBitsBucket = 32;
+
+    size_t blocks = 0;
+    // Blocks with no AC coefficients coded.
+    size_t dc_only_blocks = 0;
+    // eob_positions[i] blocks have the EOB after i coefficients in zigzag
+    // order, 64 means the block has no EOB.
+    std::array<size_t, 65> eob_positions{};
+    // Runs of zeros before the nonzero AC coefficients. ZRL codes, which skip
+    // 16 zeros, are counted apart.
+    std::array<size_t, 16> zero_runs{};
+    size_t zrl_codes = 0;
+    // Huffman codes decoded by their length in bits, index 0 is unused.
+    std::array<size_t, 17> dc_code_lengths{};
+    std::array<size_t, 17> ac_code_lengths{};
+
+    size_t mcus = 0;
+    // Bits of the entropy-coded segment without the stuffed bytes.
+    size_t bits = 0;
+    // mcu_bits[i] MCUs take from i * kMcuBitsBucket to (i + 1) *
+    // kMcuBitsBucket - 1 bits.
+    std::vector<size_t> mcu_bits{};
+
+    // Starts the scan whose MCUs consist of |blocks_per_mcu| blocks.
+    void BeginScan(size_t blocks_per_mcu);
+
+    // The code and the |value_bits| bits after it.
+    void AddDCCode(size_t code_length, size_t value_bits);
+    void AddACCode(size_t code_length, uint8_t run_size);
+
+    // Ends the block, whose EOB comes after |eob_position| coefficients.
+    void AddBlock(size_t eob_position);
+
+    // Adds the histograms of the other images, for the totals of a corpus.
+    void Merge(const BlockStats& other);
+
+    // Writes the histograms as text, one per line.
+    void Print(std::ostream& out) const;
+
+private:
+    size_t blocks_per_mcu_ = 1;
+    size_t mcu_blocks_ = 0;
+    size_t mcu_bits_ = 0;
+};
@@ -0,0 +1,61 @@
+#include "CountingResource.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+thread_local std::pmr::memory_resource* upstream = nullptr;
+thread_local size_t* allocations = nullptr;
+
+// Room in front of the block for the pointer to its upstream, which keeps the
+// alignment of the block.
+size_t HeaderSize(size_t alignment) {
+    return std::max(alignment, sizeof(std::pmr::memory_resource*));
+}
+
+size_t BlockAlignment(size_t alignment) {
+    return std::max(alignment, alignof(std::pmr::memory_resource*));
+}
+}  // namespace
+
+CountingResource* CountingResource::Get() {
+    // Blocks may be freed during the destruction of the statics.
+    static CountingResource* resource = new CountingResource;
+    return resource;
+}
+
+void* CountingResource::do_allocate(size_t bytes, size_t alignment) {
+    std::pmr::memory_resource* resource = upstream ? upstream : std::pmr::get_default_resource();
+    size_t header = HeaderSize(alignment);
+    auto* block =
+        static_cast<std::byte*>(resource->allocate(bytes + header, BlockAlignment(alignment)));
+    if (allocations) {
+        ++*allocations;
+    }
+    std::byte* pointer = block + header;
+    std::memcpy(pointer - sizeof(resource), &resource, sizeof(resource));
+    return pointer;
+}
+
+void CountingResource::do_deallocate(void* pointer, size_t bytes, size_t alignment) {
+    std::pmr::memory_resource* resource = nullptr;
+    std::memcpy(&resource, static_cast<std::byte*>(pointer) - sizeof(resource), sizeof(resource));
+    size_t header = HeaderSize(alignment);
+    resource->deallocate(static_cast<std::byte*>(pointer) - header, bytes + header,
+                         BlockAlignment(alignment));
+}
+
+bool CountingResource::do_is_equal(const std::pmr::memory_resource& other) const noexcept {
+    return this == &other;
+}
+
+AllocationCountScope::AllocationCountScope(std::pmr::memory_resource* resource, size_t* count)
+    : previous_upstream_(upstream), previous_count_(allocations) {
+    upstream = resource;
+    allocations = count;
+}
+
+AllocationCountScope::~AllocationCountScope() {
+    upstream = previous_upstream_;
+    allocations = previous_count_;
+}
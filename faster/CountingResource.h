@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <memory_resource>
+
+// Resource of the decodings which count their allocations into DecodeStats.
+// The memory comes from the upstream resource of the thread, set by
+// AllocationCountScope, which is kept in front of every block, so that the
+// images may outlive the scope and be freed from any thread.
+class CountingResource : public std::pmr::memory_resource {
+public:
+    // The only instance, which is never destroyed.
+    static CountingResource* Get();
+
+private:
+    CountingResource() = default;
+
+    void* do_allocate(size_t bytes, size_t alignment) override;
+    void do_deallocate(void* pointer, size_t bytes, size_t alignment) override;
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+};
+
+// Makes the allocations of the thread from CountingResource come from
+// |upstream| and be added to |count| until the end of the scope.
+class AllocationCountScope {
+public:
+    AllocationCountScope(std::pmr::memory_resource* upstream, size_t* count);
+
+    AllocationCountScope(const AllocationCountScope&) = delete;
+    AllocationCountScope& operator=(const AllocationCountScope&) = delete;
+
+    ~AllocationCountScope();
+
+private:
+    std::pmr::memory_resource* previous_upstream_;
+    size_t* previous_count_;
+};
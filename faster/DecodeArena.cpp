@@ -0,0 +1,48 @@
+#include <decode_arena.h>
+
+#include "JPEG_Reader.h"
+
+#include <algorithm>
+
+namespace {
+// Slack for the alignment and the bookkeeping of one allocation.
+constexpr size_t kAllocationOverhead = 32;
+// Small allocations which don't depend on the size of the image.
+constexpr size_t kFixedSize = 4096;
+
+// Bytes allocated from the resource by decoding the image.
+size_t ArenaSize(const JpegInfo& info, const DecodeOptions& options) {
+    DecodeRegion roi = ClipRegion(options.roi, info.width, info.height);
+    DecodeMemory memory = EstimateDecodeMemory(info, roi);
+    // The image is built from a prototype row, which is freed into the arena.
+    return memory.Sequential() + roi.width * sizeof(RGB) +
+           memory.allocations * kAllocationOverhead + kFixedSize;
+}
+}  // namespace
+
+class DecodeArena::Impl {
+public:
+    explicit Impl(size_t initial_size) : initial_size(initial_size), resource(initial_size) {
+    }
+
+    size_t initial_size;
+    std::pmr::monotonic_buffer_resource resource;
+};
+
+DecodeArena::DecodeArena(const JpegInfo& info, const DecodeOptions& options)
+    : impl_(std::make_unique<Impl>(ArenaSize(info, options))) {
+}
+
+std::pmr::memory_resource* DecodeArena::Resource() {
+    return &impl_->resource;
+}
+
+size_t DecodeArena::InitialSize() const {
+    return impl_->initial_size;
+}
+
+DecodeArena::DecodeArena(DecodeArena&&) = default;
+
+DecodeArena& DecodeArena::operator=(DecodeArena&&) = default;
+
+DecodeArena::~DecodeArena() = default;
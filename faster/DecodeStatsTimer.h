@@ -0,0 +1,72 @@
+#pragma once
+
+#include <decode_stats.h>
+
+#include "PerfEvents.h"
+
+#include <chrono>
+#include <cstdint>
+
+// Collection of DecodeStats is compiled in only with JPEG_DECODER_STATS, and
+// then done only if the reader was given the stats to fill.
+#ifdef JPEG_DECODER_STATS
+
+#define DECODE_STATS(statement) \
+    do {                        \
+        if (stats_) {           \
+            statement;          \
+        }                       \
+    } while (false)
+
+#define DECODE_STATS_TIMER(stage)                                                      \
+    StageTimer stage##_timer(stats_ ? &stats_->stage##_ns : nullptr,                   \
+                             stats_ && perf_counters_ ? &stats_->stage##_perf : nullptr, \
+                             perf_.get())
+
+// Adds the time from its construction to its destruction to the counter, and
+// the hardware events to |perf| if it is not null.
+class StageTimer {
+public:
+    StageTimer(uint64_t* counter, PerfCounters* perf, const PerfEventGroup* group)
+        : counter_(counter), perf_(perf), group_(group) {
+        if (perf_) {
+            perf_begin_ = group_->Read();
+        }
+        if (counter_) {
+            begin_ = std::chrono::steady_clock::now();
+        }
+    }
+
+    StageTimer(const StageTimer&) = delete;
+    StageTimer& operator=(const StageTimer&) = delete;
+
+    ~StageTimer() {
+        if (counter_) {
+            *counter_ += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                             std::chrono::steady_clock::now() - begin_)
+                             .count();
+        }
+        if (perf_) {
+            AddPerfCounters(*perf_, perf_begin_, group_->Read());
+        }
+    }
+
+private:
+    uint64_t* counter_;
+    PerfCounters* perf_;
+    const PerfEventGroup* group_;
+    std::chrono::steady_clock::time_point begin_{};
+    PerfCounters perf_begin_{};
+};
+
+#else
+
+#define DECODE_STATS(statement) \
+    do {                        \
+    } while (false)
+
+#define DECODE_STATS_TIMER(stage) \
+    do {                          \
+    } while (false)
+
+#endif
@@ -0,0 +1,34 @@
+#include "DecodeWithReader.h"
+
+#include <glog/logging.h>
+
+#include <memory>
+
+JpegReader& GetThreadReader(std::istream& input) {
+    thread_local std::unique_ptr<JpegReader> reader;
+    if (reader) {
+        reader->Reset(input);
+    } else {
+        reader = std::make_unique<JpegReader>(input);
+    }
+    return *reader;
+}
+
+Result<Image, DecodeError> DecodeWithReader(JpegReader& reader, const DecodeOptions& options,
+                                            DecodeStatus* status) {
+    // The resource may be gone by the next call.
+    MemoryResourceScope resource_scope(reader, options.memory_resource, options.stats);
+    Image image(reader.GetMemoryResource());
+    reader.SetTables(options.tables);
+    reader.SetLimits(options.limits);
+    reader.SetStats(options.stats, options.perf_counters);
+    if (!reader.ReadHeaders()) {
+        return reader.GetError();
+    }
+
+    DLOG(INFO) << "Reading SOS";
+    if (!reader.ReadSOS(image, options, status)) {
+        return reader.GetError();
+    }
+    return image;
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <decode_error.h>
+
+#include "JPEG_Reader.h"
+
+#include <istream>
+
+// Reader of the calling thread, reset to read |input|. It is kept between the
+// calls so that small images, whose decoding is dominated by the fixed costs,
+// don't pay for the IDCT handler, the buffers and the table storage every time.
+JpegReader& GetThreadReader(std::istream& input);
+
+// Decodes the image from the input of |reader| with the options of the call.
+Result<Image, DecodeError> DecodeWithReader(JpegReader& reader, const DecodeOptions& options,
+                                            DecodeStatus* status);
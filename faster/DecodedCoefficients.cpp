@@ -0,0 +1,145 @@
+#include <coefficients.h>
+#include <fft.h>
+
+#include "JPEG_Reader.h"
+
+#include <algorithm>
+
+namespace {
+// Reconstructs |size| x |size| samples of the block from its top left
+// coefficients, which is the block downscaled by 8 / size.
+class BlockRenderer {
+public:
+    explicit BlockRenderer(size_t size)
+        : size_(size), input_(size * size), output_(size * size), calc_(size, &input_, &output_) {
+    }
+
+    void Render(const int16_t* block, const std::array<uint16_t, 64>& quant_table, double* dst,
+                size_t stride) {
+        if (size_ == 1) {
+            dst[0] = block[0] * quant_table[0] / 8.0;
+            return;
+        }
+
+        for (size_t i = 0; i < size_; ++i) {
+            for (size_t j = 0; j < size_; ++j) {
+                input_[i * size_ + j] = block[i * 8 + j] * quant_table[i * 8 + j];
+            }
+        }
+        calc_.Inverse();
+        for (size_t i = 0; i < size_; ++i) {
+            std::copy(output_.begin() + i * size_, output_.begin() + (i + 1) * size_,
+                      dst + i * stride);
+        }
+    }
+
+private:
+    size_t size_;
+    std::vector<double> input_;
+    std::vector<double> output_;
+    DctCalculator calc_;
+};
+}  // namespace
+
+class DecodedCoefficients::Impl {
+public:
+    explicit Impl(JpegCoefficients in_coefficients) : coefficients(std::move(in_coefficients)) {
+    }
+
+    JpegCoefficients coefficients;
+};
+
+DecodedCoefficients::DecodedCoefficients(std::istream& input)
+    : DecodedCoefficients(DecodeCoefficients(input)) {
+}
+
+DecodedCoefficients::DecodedCoefficients(JpegCoefficients coefficients)
+    : impl_(std::make_unique<Impl>(std::move(coefficients))) {
+}
+
+const JpegInfo& DecodedCoefficients::GetInfo() const {
+    return impl_->coefficients.info;
+}
+
+const JpegCoefficients& DecodedCoefficients::GetCoefficients() const {
+    return impl_->coefficients;
+}
+
+Image DecodedCoefficients::Render(size_t scale_denom, PixelFormat format,
+                                  DecodeRegion roi) const {
+    if (scale_denom != 1 && scale_denom != 2 && scale_denom != 4 && scale_denom != 8) {
+        throw std::invalid_argument("Scale has to be 1, 2, 4 or 8");
+    }
+
+    const JpegInfo& info = impl_->coefficients.info;
+    const std::vector<ComponentCoefficients>& components = impl_->coefficients.components;
+    size_t block_size = 8 / scale_denom;
+    size_t width = (info.width + scale_denom - 1) / scale_denom;
+    size_t height = (info.height + scale_denom - 1) / scale_denom;
+    roi = ClipRegion(roi, width, height);
+
+    size_t max_h = 0;
+    size_t max_v = 0;
+    for (const ComponentCoefficients& component : components) {
+        max_h = std::max<size_t>(max_h, component.info.horizontal);
+        max_v = std::max<size_t>(max_v, component.info.vertical);
+    }
+    size_t mcu_width = max_h * block_size;
+    size_t mcu_height = max_v * block_size;
+    size_t channels = format == PixelFormat::kGrayscale ? 1 : components.size();
+
+    // Samples of one row of MCUs for every channel.
+    std::vector<std::vector<double>> planes(channels);
+    std::vector<size_t> strides(channels);
+    for (size_t c = 0; c < channels; ++c) {
+        strides[c] = components[c].width_in_blocks * block_size;
+        planes[c].resize(strides[c] * components[c].info.vertical * block_size);
+    }
+
+    BlockRenderer renderer(block_size);
+    Image image(roi.width, roi.height);
+    image.SetComment(info.comment);
+
+    size_t col_begin = roi.x / mcu_width;
+    size_t col_end = (roi.x + roi.width - 1) / mcu_width + 1;
+    size_t row_end = (roi.y + roi.height - 1) / mcu_height + 1;
+    for (size_t row = roi.y / mcu_height; row < row_end; ++row) {
+        for (size_t c = 0; c < channels; ++c) {
+            const ComponentCoefficients& component = components[c];
+            size_t h = component.info.horizontal;
+            size_t v = component.info.vertical;
+            for (size_t block_y = 0; block_y < v; ++block_y) {
+                for (size_t block_x = col_begin * h; block_x < col_end * h; ++block_x) {
+                    double* dst = planes[c].data() + block_y * block_size * strides[c] +
+                                  block_x * block_size;
+                    renderer.Render(component.Block(row * v + block_y, block_x),
+                                    component.quant_table, dst, strides[c]);
+                }
+            }
+        }
+
+        size_t y_begin = std::max(roi.y, row * mcu_height);
+        size_t y_end = std::min(roi.y + roi.height, (row + 1) * mcu_height);
+        for (size_t y = y_begin; y < y_end; ++y) {
+            size_t mcu_y = y - row * mcu_height;
+            for (size_t x = roi.x; x < roi.x + roi.width; ++x) {
+                double samples[3] = {0, 0, 0};
+                for (size_t c = 0; c < channels; ++c) {
+                    size_t sample_y = mcu_y * components[c].info.vertical / max_v;
+                    size_t sample_x = x * components[c].info.horizontal / max_h;
+                    samples[c] = planes[c][sample_y * strides[c] + sample_x];
+                }
+                image.SetPixel(y - roi.y, x - roi.x,
+                               JpegReader::GetRGB(samples[0], samples[1], samples[2]));
+            }
+        }
+    }
+
+    return image;
+}
+
+DecodedCoefficients::DecodedCoefficients(DecodedCoefficients&&) = default;
+
+DecodedCoefficients& DecodedCoefficients::operator=(DecodedCoefficients&&) = default;
+
+DecodedCoefficients::~DecodedCoefficients() = default;
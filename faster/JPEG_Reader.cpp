@@ -1,126 +1,176 @@
 #include "JPEG_Reader.h"
 #include "cassert"
 
+#include <algorithm>
+
 #include <glog/logging.h>
 
 namespace {
-template <class T>
-std::vector<std::vector<T>> ZigZag(const std::vector<T>& data) {
-    if (data.size() != 64) {
-        throw std::invalid_argument("Invalid size of data for ZigZag");
+// Position in the 8x8 block of the k-th coefficient in the zig-zag order.
+const size_t kNaturalOrder[64] = {
+    0,  1,  8,  16, 9,  2,  3,  10, 17, 24, 32, 25, 18, 11, 4,  5,  12, 19, 26, 33, 40, 48,
+    41, 34, 27, 20, 13, 6,  7,  14, 21, 28, 35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23,
+    30, 37, 44, 51, 58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63};
+
+void AddTableId(std::vector<uint8_t>& ids, uint8_t id) {
+    if (std::find(ids.begin(), ids.end(), id) == ids.end()) {
+        ids.push_back(id);
     }
-    size_t i = 0;
-    size_t j = 0;
-    size_t cur_val = 0;
-    std::vector<std::vector<T>> matrix(8, std::vector<T>(8));
-
-    while (j != 6) {
-        matrix[i][j] = data[cur_val];
-        ++cur_val;
-        ++j;
+}
 
-        matrix[i][j] = data[cur_val];
-        ++cur_val;
+const DQTTable* FindQuantTable(const JpegTables& tables, size_t idx) {
+    if (idx < tables.quant.size() && tables.quant[idx]) {
+        return &*tables.quant[idx];
+    }
+    return nullptr;
+}
 
-        while (j != 0) {
-            ++i;
-            --j;
-            matrix[i][j] = data[cur_val];
-            ++cur_val;
-        }
+const HuffmanTable* FindHuffmanTable(
+    const std::vector<std::shared_ptr<const HuffmanTable>>& tables, size_t idx) {
+    return idx < tables.size() ? tables[idx].get() : nullptr;
+}
 
-        ++i;
-        matrix[i][j] = data[cur_val];
-        ++cur_val;
+// SOF markers of the processes other than baseline, C4, C8 and CC are not SOF.
+bool IsOtherSOF(uint8_t marker) {
+    return 0xC1 <= marker && marker <= 0xCF && marker != DHT && marker != 0xC8 &&
+           marker != 0xCC;
+}
+}  // namespace
 
-        while (i != 0) {
-            --i;
-            ++j;
-            matrix[i][j] = data[cur_val];
-            ++cur_val;
-        }
-        --cur_val;
+DecodeRegion ClipRegion(DecodeRegion roi, size_t width, size_t height) {
+    if (roi.width == 0 || roi.height == 0) {
+        return {0, 0, width, height};
     }
+    if (roi.x >= width || roi.y >= height) {
+        throw std::invalid_argument("Region of interest is outside of the image");
+    }
+    roi.width = std::min(roi.width, width - roi.x);
+    roi.height = std::min(roi.height, height - roi.y);
+    return roi;
+}
 
-    matrix[i][j] = data[cur_val];
-    ++cur_val;
-    ++j;
-
-    matrix[i][j] = data[cur_val];
-    ++cur_val;
-
-    while (j != 0) {
-        ++i;
-        --j;
-        matrix[i][j] = data[cur_val];
-        ++cur_val;
+DecodeMemory EstimateDecodeMemory(const JpegInfo& info, DecodeRegion roi) {
+    size_t max_h = 1;
+    size_t max_v = 1;
+    size_t blocks_per_mcu = 0;
+    for (const JpegComponentInfo& component : info.components) {
+        max_h = std::max<size_t>(max_h, component.horizontal);
+        max_v = std::max<size_t>(max_v, component.vertical);
+        blocks_per_mcu += component.horizontal * component.vertical;
     }
-    --cur_val;
+    size_t mcu_w = (info.width + 8 * max_h - 1) / (8 * max_h);
+    size_t mcu_h = (info.height + 8 * max_v - 1) / (8 * max_v);
+
+    DecodeMemory memory;
+    memory.image = roi.height * (roi.width * sizeof(RGB) + sizeof(std::pmr::vector<RGB>));
+    memory.band = info.width * 8 * max_v * sizeof(RGB);
+    memory.row_mcus = mcu_w * (sizeof(MCU) + blocks_per_mcu * 64 * sizeof(double));
+    memory.coefficients = mcu_w * mcu_h * blocks_per_mcu * 64 * sizeof(int16_t);
+    // The rows of the image with the prototype row they are copied from and
+    // the vector of rows, the band, the vector of MCUs and their samples.
+    memory.allocations = roi.height + 4 + mcu_w;
+    return memory;
+}
 
-    while (j != 6) {
-        matrix[i][j] = data[cur_val];
-        ++cur_val;
-        ++j;
+void ThrowDecodeError(const DecodeError& error) {
+    switch (error.code) {
+        case DecodeErrorCode::kTruncated:
+            throw EndOfInput(error.message);
+        case DecodeErrorCode::kLimitExceeded:
+            throw LimitExceeded(error.message);
+        default:
+            throw std::invalid_argument(error.message);
+    }
+}
 
-        matrix[i][j] = data[cur_val];
-        ++cur_val;
+JpegReader::JpegReader(std::istream& istream)
+    : bit_reader_(istream) {
+    DLOG(INFO) << "Constructor";
+}
 
-        while (j != 7) {
-            --i;
-            ++j;
-            matrix[i][j] = data[cur_val];
-            ++cur_val;
-        }
+void JpegReader::Reset(std::istream& istream) {
+    bit_reader_.Reset(istream);
+    // The containers are cleared in place to keep their memory for the next
+    // image.
+    tables_.quant.clear();
+    tables_.dc.clear();
+    tables_.ac.clear();
+    shared_tables_.reset();
+    limits_ = DecodeLimits();
+    stats_ = nullptr;
+    perf_counters_ = false;
+    block_stats_ = nullptr;
+    channels_info_.clear();
+    max_h_ = 0;
+    max_v_ = 0;
+    std::fill(dc_coeffs_.begin(), dc_coeffs_.end(), 0);
+    info_.width = 0;
+    info_.height = 0;
+    info_.components.clear();
+    info_.quant_tables.clear();
+    info_.dc_tables.clear();
+    info_.ac_tables.clear();
+    info_.comment.clear();
+    soi_read_ = false;
+    scan_channels_ = 0;
+    mcu_w_ = 0;
+    mcu_h_ = 0;
+    current_mcu_row_ = 0;
+    current_mcu_ = 0;
+    error_ = DecodeError();
+}
 
-        ++i;
-        matrix[i][j] = data[cur_val];
-        ++cur_val;
+bool JpegReader::Fail(DecodeErrorCode code, const char* message) {
+    return Fail(code, message, bit_reader_.Offset());
+}
 
-        while (i != 7) {
-            ++i;
-            --j;
-            matrix[i][j] = data[cur_val];
-            ++cur_val;
-        }
-        --cur_val;
+bool JpegReader::Fail(DecodeErrorCode code, const char* message, size_t offset) {
+    if (bit_reader_.Ended()) {
+        code = DecodeErrorCode::kTruncated;
+        message = "Unexpected end of input";
+        offset = bit_reader_.Offset();
     }
-
-    ++j;
-    ++cur_val;
-    matrix[i][j] = data[cur_val];
-
-    return matrix;
+    error_.code = code;
+    error_.offset = offset;
+    error_.message = message;
+    return false;
 }
-}  // namespace
 
-JpegReader::JpegReader(std::istream& istream)
-    : bit_reader_(istream),
-      dc_h_ts_(4),
-      ac_h_ts_(4),
-      ch_handler_(std::vector<double>(64), std::vector<double>(64)),
-      dc_coeffs_(4, 0) {
-    DLOG(INFO) << "Constructor";
+const DecodeError& JpegReader::GetError() const {
+    return error_;
 }
 
-Markers JpegReader::GetMarker() {
+bool JpegReader::GetMarker(Markers& marker) {
+    size_t offset = bit_reader_.Offset();
     uint8_t section_begin_marker = bit_reader_.GetNextByte();
     if (section_begin_marker != SECTION_BEGIN_MARKER) {
-        throw std::runtime_error("Invalid JPEG (section does not start with 0xFF)");
+        return Fail(DecodeErrorCode::kInvalidMarker,
+                    "Invalid JPEG (section does not start with 0xFF)", offset);
     }
 
     uint8_t section_marker = bit_reader_.GetNextByte();
+    if (bit_reader_.Ended()) {
+        return Fail(DecodeErrorCode::kTruncated, "Unexpected end of input");
+    }
+    DECODE_STATS(++stats_->markers);
 
     if (START_APP <= section_marker && section_marker <= END_APP) {
-        return APP;
+        marker = APP;
+        return true;
     }
 
+    if (IsOtherSOF(section_marker)) {
+        return Fail(DecodeErrorCode::kUnsupported, "Only baseline images are supported", offset);
+    }
     if (section_marker != SOI && section_marker != EOI && section_marker != COM &&
         section_marker != DQT && section_marker != SOF0 && section_marker != DHT &&
         section_marker != SOS) {
-        throw std::runtime_error("Invalid JPEG (invalid section marker)");
+        return Fail(DecodeErrorCode::kInvalidMarker, "Invalid JPEG (invalid section marker)",
+                    offset);
     }
 
-    return static_cast<Markers>(section_marker);
+    marker = static_cast<Markers>(section_marker);
+    return true;
 }
 
 int JpegReader::GetNumber(size_t length, bool skip_ff) {
@@ -141,60 +191,68 @@ int JpegReader::GetNumber(size_t length, bool skip_ff) {
     }
 }
 
-size_t JpegReader::GetLength() {
-    uint16_t length = bit_reader_.GetNextByte();
-    length <<= 8;
-    length |= bit_reader_.GetNextByte();
-    return length - 2;
+bool JpegReader::GetLength(size_t& length) {
+    size_t offset = bit_reader_.Offset();
+    uint16_t value = bit_reader_.GetNextByte();
+    value <<= 8;
+    value |= bit_reader_.GetNextByte();
+    if (value < 2) {
+        return Fail(DecodeErrorCode::kInvalidHeader, "Invalid section length", offset);
+    }
+    length = value - 2;
+    return true;
 }
 
-void JpegReader::ReadComment(Image& image) {
+bool JpegReader::ReadComment() {
     DLOG(INFO) << "Comment";
-    size_t comment_length = GetLength();
+    size_t comment_length = 0;
+    if (!GetLength(comment_length)) {
+        return false;
+    }
     std::string comment;
     for (size_t i = 0; i < comment_length; ++i) {
         comment += bit_reader_.GetNextByte();
     }
 
-    image.SetComment(comment);
+    info_.comment = std::move(comment);
+    return true;
 }
 
-void JpegReader::ReadApp() {
+bool JpegReader::ReadApp() {
     DLOG(INFO) << "App";
-    size_t comment_length = GetLength();
+    DECODE_STATS(++stats_->segments_skipped);
+    size_t comment_length = 0;
+    if (!GetLength(comment_length)) {
+        return false;
+    }
     for (size_t i = 0; i < comment_length; ++i) {
         bit_reader_.GetNextByte();
     }
+    return true;
 }
 
-void JpegReader::ReadDQT() {
+bool JpegReader::ReadDQT() {
     DLOG(INFO) << "DQT";
-    size_t section_length = GetLength();
+    size_t section_length = 0;
+    if (!GetLength(section_length)) {
+        return false;
+    }
     size_t read_bytes = 0;
     while (read_bytes < section_length) {
         uint8_t table_idx = 0;
         uint8_t value_size = 0;
         uint8_t half_byte = bit_reader_.GetNextByte();
         ++read_bytes;
-        if (read_bytes > section_length) {
-            throw std::invalid_argument("Invalid section length");
-        }
         table_idx = half_byte & 0x0F;
         value_size = half_byte & 0xF0;
 
-        if (dqt_tables_.size() < table_idx + 1) {
-            dqt_tables_.resize(table_idx + 1);
-        }
-
-        std::vector<int> data;
-        data.reserve(64);
-
+        DQTTable table;
         for (size_t i = 0; i < 64; ++i) {
             uint16_t value = 0;
             value = bit_reader_.GetNextByte();
             ++read_bytes;
             if (read_bytes > section_length) {
-                throw std::invalid_argument("Invalid section length");
+                return Fail(DecodeErrorCode::kInvalidHeader, "Invalid section length");
             }
             if (value_size) {
                 value <<= 8;
@@ -202,17 +260,29 @@ void JpegReader::ReadDQT() {
                 ++read_bytes;
             }
 
-            data.push_back(value);
+            table[kNaturalOrder[i]] = value;
         }
 
-        assert(data.size() == 64);
-        dqt_tables_[table_idx] = ZigZag(data);
+        // What is read past the end is not a table, and must not replace the
+        // one of an earlier section.
+        if (bit_reader_.Ended()) {
+            return Fail(DecodeErrorCode::kTruncated, "Unexpected end of input");
+        }
+        if (tables_.quant.size() < table_idx + 1u) {
+            tables_.quant.resize(table_idx + 1);
+        }
+        AddTableId(info_.quant_tables, table_idx);
+        tables_.quant[table_idx] = table;
     }
+    return true;
 }
 
-void JpegReader::ReadHT() {
+bool JpegReader::ReadHT() {
     DLOG(INFO) << "HT";
-    size_t section_length = GetLength();
+    size_t section_length = 0;
+    if (!GetLength(section_length)) {
+        return false;
+    }
     size_t read_bytes = 0;
     while (read_bytes < section_length) {
         uint8_t half_byte = bit_reader_.GetNextByte();
@@ -220,22 +290,17 @@ void JpegReader::ReadHT() {
         size_t table_idx = half_byte & 0x0F;
         size_t table_class = half_byte & 0xF0;
 
-        std::vector<uint8_t> code_lengths;
-        code_lengths.reserve(16);
-
+        std::array<uint8_t, 16> code_lengths;
         size_t values_cnt = 0;
 
         for (size_t i = 0; i < 16; ++i) {
-            uint8_t code_length = bit_reader_.GetNextByte();
+            code_lengths[i] = bit_reader_.GetNextByte();
             ++read_bytes;
-            code_lengths.push_back(code_length);
-            values_cnt += code_length;
+            values_cnt += code_lengths[i];
         }
 
-        assert(code_lengths.size() == 16);
-
-        std::vector<uint8_t> values;
-        values.reserve(values_cnt);
+        std::vector<uint8_t>& values = ht_values_;
+        values.clear();
 
         for (size_t i = 0; i < values_cnt; ++i) {
             uint8_t value = bit_reader_.GetNextByte();
@@ -243,33 +308,45 @@ void JpegReader::ReadHT() {
             values.push_back(value);
         }
         assert(values.size() == values_cnt);
+        if (bit_reader_.Ended()) {
+            return Fail(DecodeErrorCode::kTruncated, "Unexpected end of input");
+        }
+        if (!HuffmanTable::Valid(code_lengths)) {
+            return Fail(DecodeErrorCode::kInvalidHeader, "Incorrect code lengths");
+        }
 
         if (table_class) {
-            if (ac_h_ts_.size() < table_idx + 1) {
-                ac_h_ts_.resize(table_idx + 1);
+            AddTableId(info_.ac_tables, table_idx);
+            if (tables_.ac.size() < table_idx + 1) {
+                tables_.ac.resize(table_idx + 1);
             }
-            ac_h_ts_[table_idx].Build(code_lengths, values);
+            tables_.ac[table_idx] = HuffmanTable::Get(code_lengths, values);
         } else {
-            if (dc_h_ts_.size() < table_idx + 1) {
-                dc_h_ts_.resize(table_idx + 1);
+            AddTableId(info_.dc_tables, table_idx);
+            if (tables_.dc.size() < table_idx + 1) {
+                tables_.dc.resize(table_idx + 1);
             }
-            dc_h_ts_[table_idx].Build(code_lengths, values);
+            tables_.dc[table_idx] = HuffmanTable::Get(code_lengths, values);
         }
     }
+    return true;
 }
 
-void JpegReader::ReadSOF0(Image& image) {
+bool JpegReader::ReadSOF0() {
     DLOG(INFO) << "SOF0";
+    size_t offset = bit_reader_.Offset() - 2;
     if (!channels_info_.empty()) {
-        throw std::invalid_argument("Can't read two SOF0 sections");
+        return Fail(DecodeErrorCode::kInvalidHeader, "Can't read two SOF0 sections", offset);
     }
-    channels_info_.resize(4);
 
-    size_t section_length = GetLength();
+    size_t section_length = 0;
+    if (!GetLength(section_length)) {
+        return false;
+    }
     uint8_t precision = bit_reader_.GetNextByte();
 
     if (precision != 8) {
-        throw std::invalid_argument("Invalid precision");
+        return Fail(DecodeErrorCode::kUnsupported, "Invalid precision", offset);
     }
 
     size_t height = bit_reader_.GetNextByte();
@@ -280,19 +357,178 @@ void JpegReader::ReadSOF0(Image& image) {
     width <<= 8;
     width |= bit_reader_.GetNextByte();
 
-    image.SetSize(width, height);
+    if (width == 0 || height == 0) {
+        return Fail(DecodeErrorCode::kInvalidHeader, "Invalid image size", offset);
+    }
+    if (limits_.max_dimension && std::max(width, height) > limits_.max_dimension) {
+        return Fail(DecodeErrorCode::kLimitExceeded, "Image size exceeds the limit", offset);
+    }
+    if (limits_.max_pixels && width * height > limits_.max_pixels) {
+        return Fail(DecodeErrorCode::kLimitExceeded, "Image has more pixels than the limit",
+                    offset);
+    }
 
     uint8_t channels_number = bit_reader_.GetNextByte();
 
+    // Nothing is stored until the whole section is read, so that the section
+    // can be read again from the start if the input ends in the middle of it.
+    std::array<ChannelInfo, 4> channels_info{};
+    std::array<JpegComponentInfo, 256> components;
     for (size_t i = 0; i < channels_number; ++i) {
         uint8_t idx = bit_reader_.GetNextByte();
         uint8_t half_byte = bit_reader_.GetNextByte();
-        channels_info_[idx].horizontal = (half_byte & 0xF0) >> 4;
-        max_h_ = std::max(max_h_, channels_info_[idx].horizontal);
-        channels_info_[idx].vertical = half_byte & 0x0F;
-        max_v_ = std::max(max_v_, channels_info_[idx].vertical);
-        channels_info_[idx].dqt_table = bit_reader_.GetNextByte();
+        uint8_t dqt_table = bit_reader_.GetNextByte();
+        if (idx >= channels_info.size()) {
+            return Fail(DecodeErrorCode::kInvalidHeader, "Invalid channel idx");
+        }
+        channels_info[idx].horizontal = (half_byte & 0xF0) >> 4;
+        channels_info[idx].vertical = half_byte & 0x0F;
+        // MCU keeps no more than 2x2 blocks of a channel.
+        if (channels_info[idx].horizontal < 1 || channels_info[idx].horizontal > 2 ||
+            channels_info[idx].vertical < 1 || channels_info[idx].vertical > 2) {
+            return Fail(DecodeErrorCode::kUnsupported, "Unsupported sampling factors");
+        }
+        channels_info[idx].dqt_table = dqt_table;
+        components[i] = {idx, channels_info[idx].horizontal, channels_info[idx].vertical,
+                         dqt_table};
     }
+    if (bit_reader_.Ended()) {
+        return Fail(DecodeErrorCode::kTruncated, "Unexpected end of input");
+    }
+
+    for (const ChannelInfo& channel : channels_info) {
+        max_h_ = std::max(max_h_, channel.horizontal);
+        max_v_ = std::max(max_v_, channel.vertical);
+    }
+    channels_info_.assign(channels_info.begin(), channels_info.end());
+    info_.width = width;
+    info_.height = height;
+    info_.components.assign(components.begin(), components.begin() + channels_number);
+    return true;
+}
+
+void JpegReader::SetTables(std::shared_ptr<const JpegTables> tables) {
+    shared_tables_ = std::move(tables);
+}
+
+void JpegReader::SetLimits(const DecodeLimits& limits) {
+    limits_ = limits;
+}
+
+void JpegReader::SetMemoryResource(std::pmr::memory_resource* resource) {
+    if (!resource) {
+        resource = std::pmr::get_default_resource();
+    }
+    if (GetMemoryResource() != resource) {
+        buffers_.emplace(resource);
+    }
+}
+
+std::pmr::memory_resource* JpegReader::GetMemoryResource() const {
+    return buffers_->band.get_allocator().resource();
+}
+
+void JpegReader::TrimBuffers(size_t max_bytes) {
+    size_t mcu_bytes = sizeof(MCU) + blocks_per_mcu_ * 64 * sizeof(double);
+    size_t bytes = buffers_->band.capacity() * sizeof(RGB) +
+                   buffers_->row_mcus.capacity() * mcu_bytes;
+    if (bytes > max_bytes) {
+        buffers_.emplace(GetMemoryResource());
+    }
+}
+
+MemoryResourceScope::MemoryResourceScope(JpegReader& reader, std::pmr::memory_resource* resource,
+                                         [[maybe_unused]] DecodeStats* stats)
+    : reader_(reader), release_(resource != nullptr) {
+#ifdef JPEG_DECODER_STATS
+    if (stats) {
+        count_scope_.emplace(resource ? resource : std::pmr::get_default_resource(),
+                             &stats->allocations);
+        resource = CountingResource::Get();
+    }
+#endif
+    reader_.SetMemoryResource(resource);
+}
+
+MemoryResourceScope::~MemoryResourceScope() {
+    if (release_) {
+        reader_.SetMemoryResource(nullptr);
+    }
+}
+
+void JpegReader::SetBlockStats(BlockStats* block_stats) {
+    block_stats_ = block_stats;
+}
+
+void JpegReader::SetStats(DecodeStats* stats, bool perf_counters) {
+    stats_ = stats;
+    DECODE_STATS(stats_start_ = bit_reader_.GetState().position);
+    perf_counters_ = perf_counters;
+    // The group counts the thread which opens it, so it is kept as long as
+    // the reader is used on that thread.
+    DECODE_STATS(if (perf_counters && (!perf_ || !perf_->CountsCallingThread())) {
+        perf_ = std::make_unique<PerfEventGroup>();
+    });
+}
+
+bool JpegReader::CheckLimits(size_t memory) {
+    if (limits_.max_memory && memory > limits_.max_memory) {
+        return Fail(DecodeErrorCode::kLimitExceeded, "Image needs more memory than the limit");
+    }
+    if (limits_.max_pixels_per_input_byte) {
+        std::streamoff bytes = bit_reader_.BytesLeft();
+        if (bytes >= 0 && info_.width * info_.height >
+                              limits_.max_pixels_per_input_byte * static_cast<size_t>(bytes)) {
+            return Fail(DecodeErrorCode::kLimitExceeded,
+                        "Image has too many pixels for the input size");
+        }
+    }
+    return true;
+}
+
+std::shared_ptr<const JpegTables> JpegReader::ReadTables() {
+    Markers marker{};
+    if (!GetMarker(marker) || marker != SOI) {
+        Fail(DecodeErrorCode::kNotJpeg, "Tables have to start with SOI marker", 0);
+        return nullptr;
+    }
+    while (true) {
+        size_t offset = bit_reader_.Offset();
+        if (!GetMarker(marker)) {
+            return nullptr;
+        }
+        bool ok = false;
+        switch (marker) {
+            case COM:
+                ok = ReadComment();
+                break;
+            case APP:
+                ok = ReadApp();
+                break;
+            case DQT:
+                ok = ReadDQT();
+                break;
+            case DHT:
+                ok = ReadHT();
+                break;
+            case EOI:
+                return std::make_shared<const JpegTables>(tables_);
+            default:
+                Fail(DecodeErrorCode::kInvalidMarker, "Unexpected section in tables-only stream",
+                     offset);
+                return nullptr;
+        }
+        if (!ok || bit_reader_.Ended()) {
+            if (ok) {
+                Fail(DecodeErrorCode::kTruncated, "Unexpected end of input");
+            }
+            return nullptr;
+        }
+    }
+}
+
+const JpegInfo& JpegReader::GetInfo() const {
+    return info_;
 }
 
 RGB JpegReader::GetRGB(double y, double cb, double cr) {
@@ -311,167 +547,523 @@ RGB JpegReader::GetRGB(double y, double cb, double cr) {
     return {r, g, b};
 }
 
-MCU JpegReader::ReadMCU(size_t channels_cnt) {
-    MCU mcu;
-    std::vector<double> data(64);
-
-    for (size_t channel = 1; channel <= channels_cnt; ++channel) {
-        for (size_t h = 0; h < channels_info_[channel].vertical; ++h) {
-            for (size_t v = 0; v < channels_info_[channel].horizontal; ++v) {
-
-                int dc_coeff_len = 0;
-                while (!dc_h_ts_[channels_info_[channel].dc_table_idx].Move(
-                    bit_reader_.GetNextBit(true), dc_coeff_len)) {
-                }
-                dc_coeffs_[channel] += GetNumber(dc_coeff_len, true);
-                data[0] = dc_coeffs_[channel];
+bool JpegReader::ReadBlock(size_t channel, int16_t* coefficients) {
+    const ChannelInfo& channel_info = channels_info_[channel];
+    if (!channel_info.dc_table || !channel_info.ac_table) {
+        return Fail(DecodeErrorCode::kInvalidHeader, "DHT table with such idx does not exist");
+    }
+    DECODE_STATS(++stats_->blocks);
+    size_t code_length = 0;
+    size_t* code_length_ptr = block_stats_ ? &code_length : nullptr;
+    uint8_t dc_length = 0;
+    if (!channel_info.dc_table->Decode(bit_reader_, dc_length, code_length_ptr)) {
+        return Fail(DecodeErrorCode::kInvalidScan, "Invalid Huffman code");
+    }
+    if (block_stats_) {
+        block_stats_->AddDCCode(code_length, dc_length);
+    }
+    dc_coeffs_[channel] += GetNumber(dc_length, true);
+    coefficients[0] = dc_coeffs_[channel];
+
+    size_t read_values = 1;
+    size_t eob_position = 64;
+    while (read_values < 64) {
+        uint8_t half_byte = 0;
+        if (!channel_info.ac_table->Decode(bit_reader_, half_byte, code_length_ptr)) {
+            return Fail(DecodeErrorCode::kInvalidScan, "Invalid Huffman code");
+        }
+        if (block_stats_) {
+            block_stats_->AddACCode(code_length, half_byte);
+        }
 
-                size_t read_values = 1;
-                while (read_values < 64) {
-                    int half_byte = 0;
+        if (half_byte == 0) {
+            eob_position = read_values;
+            break;
+        }
 
-                    while (!ac_h_ts_[channels_info_[channel].ac_table_idx].Move(
-                        bit_reader_.GetNextBit(true), half_byte)) {
-                    }
+        size_t zeros_cnt = (half_byte & 0xF0) >> 4;
+        size_t ac_coeff_len = half_byte & 0x0F;
 
-                    if (half_byte == 0) {
-                        break;
-                    }
+        if (read_values + zeros_cnt >= 64) {
+            return Fail(DecodeErrorCode::kInvalidScan, "Too many coefficients in a block");
+        }
+        for (size_t _ = 0; _ < zeros_cnt; ++_) {
+            coefficients[kNaturalOrder[read_values]] = 0;
+            ++read_values;
+        }
+        coefficients[kNaturalOrder[read_values]] = GetNumber(ac_coeff_len, true);
+        ++read_values;
+    }
+    if (block_stats_) {
+        block_stats_->AddBlock(eob_position);
+    }
 
-                    size_t zeros_cnt = (half_byte & 0xF0) >> 4;
-                    size_t ac_coeff_len = half_byte & 0x0F;
+    while (read_values < 64) {
+        coefficients[kNaturalOrder[read_values]] = 0;
+        ++read_values;
+    }
+    return true;
+}
 
-                    for (size_t _ = 0; _ < zeros_cnt; ++_) {
-                        data[read_values] = 0;
-                        ++read_values;
-                    }
-                    data[read_values] = GetNumber(ac_coeff_len, true);
-                    ++read_values;
-                }
+bool JpegReader::ReadMCU(size_t channels_cnt, MCU& mcu) {
+    mcu.Resize(channels_info_, channels_cnt);
+    int16_t coefficients[64];
 
-                while (read_values < 64) {
-                    data[read_values] = 0;
-                    ++read_values;
+    for (size_t channel = 1; channel <= channels_cnt; ++channel) {
+        for (size_t h = 0; h < channels_info_[channel].vertical; ++h) {
+            for (size_t v = 0; v < channels_info_[channel].horizontal; ++v) {
+                if (!ReadBlock(channel, coefficients)) {
+                    return false;
                 }
-
-                std::vector<std::vector<double>> matrix = ZigZag(data);
-                mcu.mcu_[channel][h][v] = std::move(matrix);
+                std::copy(coefficients, coefficients + 64, mcu.Block(channel, h, v));
             }
         }
     }
-
-    return mcu;
+    if (bit_reader_.Ended()) {
+        return Fail(DecodeErrorCode::kTruncated, "Unexpected end of input");
+    }
+    return true;
 }
 
-MCU::MCU() {
-    mcu_.resize(4);
-    for (size_t i = 1; i < 4; ++i) {
-        mcu_[i].resize(2);
-        for (size_t j = 0; j < 2; ++j) {
-            mcu_[i][j].resize(2);
+bool JpegReader::SkipMCU(size_t channels_cnt) {
+    int16_t coefficients[64];
+    for (size_t channel = 1; channel <= channels_cnt; ++channel) {
+        size_t blocks = channels_info_[channel].vertical * channels_info_[channel].horizontal;
+        for (size_t i = 0; i < blocks; ++i) {
+            if (!ReadBlock(channel, coefficients)) {
+                return false;
+            }
         }
     }
+    if (bit_reader_.Ended()) {
+        return Fail(DecodeErrorCode::kTruncated, "Unexpected end of input");
+    }
+    return true;
 }
 
-void JpegReader::HandleMCU(MCU& mcu, size_t channels_cnt) {
+void MCU::Resize(const std::vector<ChannelInfo>& channels_info, size_t channels_cnt) {
+    size_t blocks = 0;
     for (size_t channel = 1; channel <= channels_cnt; ++channel) {
+        offsets_[channel] = blocks;
+        horizontal_[channel] = channels_info[channel].horizontal;
+        blocks += channels_info[channel].horizontal * channels_info[channel].vertical;
+    }
+    data_.resize(blocks * 64);
+}
+
+bool JpegReader::HandleMCU(MCU& mcu, size_t channels_cnt) {
+    if (!ch_handler_) {
+        ch_handler_ = std::make_unique<ChannelHandler>(std::vector<double>(64),
+                                                       std::vector<double>(64));
+    }
+    for (size_t channel = 1; channel <= channels_cnt; ++channel) {
+        const DQTTable* quant = channels_info_[channel].quant;
+        if (!quant) {
+            return Fail(DecodeErrorCode::kInvalidHeader, "DQT table with such idx does not exist");
+        }
         for (size_t h = 0; h < channels_info_[channel].vertical; ++h) {
             for (size_t v = 0; v < channels_info_[channel].horizontal; ++v) {
-                for (size_t i = 0; i < 8; ++i) {
-                    for (size_t j = 0; j < 8; ++j) {
-                        if (dqt_tables_.size() <= channels_info_[channel].dqt_table) {
-                            throw std::runtime_error("DQT table with such idx does not exist");
-                        }
-                        mcu.mcu_[channel][h][v][i][j] *=
-                            dqt_tables_[channels_info_[channel].dqt_table][i][j];
-                    }
-                }
-
-                for (size_t i = 0; i < 64; ++i) {
-                    ch_handler_.input[i] = mcu.mcu_[channel][h][v][i >> 3][i & 0b111];
-                }
-                ch_handler_.calc.Inverse();
+                double* block = mcu.Block(channel, h, v);
                 for (size_t i = 0; i < 64; ++i) {
-                    mcu.mcu_[channel][h][v][i >> 3][i & 0b111] = ch_handler_.output[i];
+                    ch_handler_->input[i] = block[i] * (*quant)[i];
                 }
+                ch_handler_->calc.Inverse();
+                std::copy(ch_handler_->output.begin(), ch_handler_->output.end(), block);
             }
         }
     }
+    return true;
 }
 
-std::vector<std::vector<RGB>> JpegReader::ToRGB(MCU& mcu, size_t channels_cnt) {
-    std::vector<std::vector<RGB>> ans(max_v_ * 8, std::vector<RGB>(max_h_ * 8));
+void JpegReader::ToRGB(const MCU& mcu, size_t channels_cnt, RGB* out, size_t stride,
+                       size_t columns) {
     size_t move_v = max_v_ == 2 ? 1 : 0;
     size_t move_h = max_h_ == 2 ? 1 : 0;
+    // The sample of the channel at the pixel (i, j) of the MCU.
+    auto sample = [&](size_t channel, size_t i, size_t j) {
+        size_t y = i * channels_info_[channel].vertical >> move_v;
+        size_t x = j * channels_info_[channel].horizontal >> move_h;
+        return mcu.Block(channel, y >> 3, x >> 3)[(y & 0b111) * 8 + (x & 0b111)];
+    };
 
+    columns = std::min<size_t>(columns, max_h_ * 8);
     for (size_t i = 0; i < max_v_ * 8; ++i) {
-        for (size_t j = 0; j < max_h_ * 8; ++j) {
-            double y = mcu.mcu_[1][i * channels_info_[1].vertical >> move_v >> 3]
-                               [j * channels_info_[1].horizontal >> move_h >> 3]
-                               [i * channels_info_[1].vertical >> move_v & 0b111]
-                               [j * channels_info_[1].horizontal >> move_h & 0b111];
-            double cb = channels_cnt > 1
-                            ? mcu.mcu_[2][i * channels_info_[2].vertical >> move_v >> 3]
-                                      [j * channels_info_[2].horizontal >> move_h >> 3]
-                                      [i * channels_info_[2].vertical >> move_v & 0b111]
-                                      [j * channels_info_[2].horizontal >> move_h & 0b111]
-                            : 0;
-            double cr = channels_cnt > 2
-                            ? mcu.mcu_[3][i * channels_info_[3].vertical >> move_v >> 3]
-                                      [j * channels_info_[3].horizontal >> move_h >> 3]
-                                      [i * channels_info_[3].vertical >> move_v & 0b111]
-                                      [j * channels_info_[3].horizontal >> move_h & 0b111]
-                            : 0;
-            ans[i][j] = GetRGB(y, cb, cr);
-        }
-    }
-
-    return ans;
-}
-
-void JpegReader::ReadSOS(Image& image) {
+        for (size_t j = 0; j < columns; ++j) {
+            double y = sample(1, i, j);
+            double cb = channels_cnt > 1 ? sample(2, i, j) : 0;
+            double cr = channels_cnt > 2 ? sample(3, i, j) : 0;
+            out[i * stride + j] = GetRGB(y, cb, cr);
+        }
+    }
+}
+
+bool JpegReader::ReadHeaders() {
+    DECODE_STATS_TIMER(header);
+    TRACE_SPAN("headers");
+    bool sos = false;
+    while (!sos) {
+        if (!ReadSection(sos)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool JpegReader::ReadSection(bool& sos) {
+    sos = false;
+    Markers marker{};
+    if (!soi_read_) {
+        if (!GetMarker(marker) || marker != SOI) {
+            return Fail(DecodeErrorCode::kNotJpeg, "Image has to start with SOI marker", 0);
+        }
+        DLOG(INFO) << "Found SOI";
+        soi_read_ = true;
+        return true;
+    }
+
+    size_t offset = bit_reader_.Offset();
+    if (!GetMarker(marker)) {
+        return false;
+    }
+    bool ok = false;
+    switch (marker) {
+        case SOI:
+            DLOG(ERROR) << "SOI in the middle";
+            return Fail(DecodeErrorCode::kInvalidMarker, "Invalid Marker", offset);
+        case EOI:
+            DLOG(ERROR) << "EOI in the middle";
+            return Fail(DecodeErrorCode::kInvalidMarker, "Invalid Marker", offset);
+        case COM:
+            DLOG(INFO) << "Reading commentary";
+            ok = ReadComment();
+            break;
+        case APP:
+            DLOG(INFO) << "Reading APP";
+            ok = ReadApp();
+            break;
+        case DQT:
+            DLOG(INFO) << "Reading DQT";
+            ok = ReadDQT();
+            break;
+        case SOF0:
+            DLOG(INFO) << "Reading SOF0";
+            ok = ReadSOF0();
+            break;
+        case DHT:
+            DLOG(INFO) << "Reading HT";
+            ok = ReadHT();
+            break;
+        case SOS:
+            if (channels_info_.empty()) {
+                return Fail(DecodeErrorCode::kInvalidHeader, "SOS section before SOF0", offset);
+            }
+            sos = true;
+            return true;
+        default:
+            DLOG(ERROR) << "Unknown marker";
+            return Fail(DecodeErrorCode::kInvalidMarker, "Invalid marker", offset);
+    }
+    if (ok && bit_reader_.Ended()) {
+        return Fail(DecodeErrorCode::kTruncated, "Unexpected end of input");
+    }
+    return ok;
+}
+
+JpegReader::Checkpoint JpegReader::SaveCheckpoint() {
+    return {bit_reader_.GetState(), dc_coeffs_, current_mcu_row_, current_mcu_};
+}
+
+void JpegReader::RestoreCheckpoint(const Checkpoint& checkpoint) {
+    bit_reader_.SetState(checkpoint.bit_reader_state);
+    dc_coeffs_ = checkpoint.dc_coeffs;
+    current_mcu_row_ = checkpoint.mcu_row;
+    current_mcu_ = checkpoint.mcu;
+    error_ = DecodeError();
+}
+
+bool JpegReader::ReadSOSHeader() {
     DLOG(INFO) << "SOS";
-    size_t section_length = GetLength();
+    size_t section_length = 0;
+    if (!GetLength(section_length)) {
+        return false;
+    }
     uint8_t channels_count = bit_reader_.GetNextByte();
+    if (channels_count == 0 || channels_count >= channels_info_.size()) {
+        return Fail(DecodeErrorCode::kInvalidHeader, "Invalid number of channels in SOS");
+    }
     for (size_t i = 0; i < channels_count; ++i) {
         uint8_t channel_idx = bit_reader_.GetNextByte();
         uint8_t half_byte = bit_reader_.GetNextByte();
         if (channels_info_.size() <= channel_idx) {
-            throw std::runtime_error("No info about channel with such idx");
+            return Fail(DecodeErrorCode::kInvalidHeader, "No info about channel with such idx");
         }
 
-        channels_info_[channel_idx].dc_table_idx = (half_byte & 0xF0) >> 4;
-        channels_info_[channel_idx].ac_table_idx = half_byte & 0x0F;
+        ChannelInfo& channel = channels_info_[channel_idx];
+        channel.dc_table_idx = (half_byte & 0xF0) >> 4;
+        channel.ac_table_idx = half_byte & 0x0F;
+
+        // Abbreviated images take the tables they miss from the shared set,
+        // and the ones without any DHT use the standard Huffman tables.
+        channel.quant = FindQuantTable(tables_, channel.dqt_table);
+        channel.dc_table = FindHuffmanTable(tables_.dc, channel.dc_table_idx);
+        channel.ac_table = FindHuffmanTable(tables_.ac, channel.ac_table_idx);
+        if (shared_tables_) {
+            if (!channel.quant) {
+                channel.quant = FindQuantTable(*shared_tables_, channel.dqt_table);
+            }
+            if (!channel.dc_table) {
+                channel.dc_table = FindHuffmanTable(shared_tables_->dc, channel.dc_table_idx);
+            }
+            if (!channel.ac_table) {
+                channel.ac_table = FindHuffmanTable(shared_tables_->ac, channel.ac_table_idx);
+            }
+        }
+        if (info_.dc_tables.empty() && info_.ac_tables.empty()) {
+            if (!channel.dc_table) {
+                channel.dc_table = GetDefaultDCTable(channel.dc_table_idx).get();
+            }
+            if (!channel.ac_table) {
+                channel.ac_table = GetDefaultACTable(channel.ac_table_idx).get();
+            }
+        }
     }
 
     if (bit_reader_.GetNextByte(true) != 0 || bit_reader_.GetNextByte(true) != 0x3F ||
         bit_reader_.GetNextByte(true) != 0) {
-        throw std::invalid_argument("Invalid Meta info SOS marker");
+        return Fail(DecodeErrorCode::kUnsupported, "Invalid Meta info SOS marker");
     };
+    if (bit_reader_.Ended()) {
+        return Fail(DecodeErrorCode::kTruncated, "Unexpected end of input");
+    }
 
-    size_t mcu_w = (image.Width() - 1) / (8 * max_h_) + 1;
-    size_t mcu_h = (image.Height() - 1) / (8 * max_v_) + 1;
-
-    for (size_t i = 0; i < mcu_h; ++i) {
-        for (size_t j = 0; j < mcu_w; ++j) {
-            MCU mcu = ReadMCU(channels_count);
-            HandleMCU(mcu, channels_count);
+    scan_channels_ = channels_count;
+    blocks_per_mcu_ = 0;
+    for (size_t channel = 1; channel <= scan_channels_; ++channel) {
+        blocks_per_mcu_ += channels_info_[channel].horizontal * channels_info_[channel].vertical;
+    }
+    if (block_stats_) {
+        block_stats_->BeginScan(blocks_per_mcu_);
+    }
+    mcu_w_ = (info_.width - 1) / (8 * max_h_) + 1;
+    mcu_h_ = (info_.height - 1) / (8 * max_v_) + 1;
+    current_mcu_row_ = 0;
+    current_mcu_ = 0;
+    return true;
+}
 
-            std::vector<std::vector<RGB>> rgb = ToRGB(mcu, channels_count);
+bool JpegReader::ReadMCURow(std::pmr::vector<RGB>& band, size_t x_begin, size_t x_end,
+                            Checkpoint* progress) {
+    size_t mcu_width = 8 * max_h_;
+    std::pmr::vector<MCU>& row_mcus = buffers_->row_mcus;
+    band.resize(info_.width * McuHeight());
+    row_mcus.resize(mcu_w_);
+    DECODE_STATS(stats_->mcus += mcu_w_);
+
+    // MCUs outside of the columns are read only to keep DC prediction going.
+    size_t j_begin = std::min(mcu_w_, x_begin / mcu_width);
+    size_t j_end = std::min(mcu_w_, (std::min(x_end, info_.width) + mcu_width - 1) / mcu_width);
+    if (x_begin >= x_end) {
+        j_begin = j_end = 0;
+    }
 
-            for (size_t y = i * 8 * max_v_; y < std::min(image.Height(), (i + 1) * 8 * max_v_);
-                 ++y) {
-                for (size_t x = j * 8 * max_h_; x < std::min(image.Width(), (j + 1) * 8 * max_h_);
-                     ++x) {
-                    size_t by = y - i * 8 * max_v_;
-                    size_t bx = x - j * 8 * max_h_;
-                    image.SetPixel(y, x, rgb[by][bx]);
-                }
+    // The row goes through every stage before the next one, so that each of
+    // them runs over a batch of MCUs.
+    {
+        DECODE_STATS_TIMER(entropy);
+        TRACE_SPAN("entropy");
+        for (size_t j = current_mcu_; j < mcu_w_; ++j) {
+            bool ok = j < j_begin || j >= j_end ? SkipMCU(scan_channels_)
+                                                : ReadMCU(scan_channels_, row_mcus[j]);
+            if (!ok) {
+                return false;
+            }
+            current_mcu_ = j + 1;
+            if (progress) {
+                *progress = SaveCheckpoint();
             }
         }
     }
+    {
+        DECODE_STATS_TIMER(idct);
+        TRACE_SPAN("idct");
+        for (size_t j = j_begin; j < j_end; ++j) {
+            if (!HandleMCU(row_mcus[j], scan_channels_)) {
+                return false;
+            }
+        }
+    }
+    {
+        DECODE_STATS_TIMER(color);
+        TRACE_SPAN("color");
+        for (size_t j = j_begin; j < j_end; ++j) {
+            ToRGB(row_mcus[j], scan_channels_, band.data() + j * mcu_width, info_.width,
+                  info_.width - j * mcu_width);
+        }
+    }
 
+    ++current_mcu_row_;
+    current_mcu_ = 0;
+    if (progress) {
+        *progress = SaveCheckpoint();
+    }
+    return true;
+}
+
+bool JpegReader::CheckEOI() {
     if (bit_reader_.PeekNextBytes() != 0xFFD9) {
-        throw std::invalid_argument("File does not end with proper marker");
+        return Fail(DecodeErrorCode::kInvalidScan, "File does not end with proper marker");
+    }
+    return true;
+}
+
+bool JpegReader::ReadEOI() {
+    bit_reader_.AlignToByte();
+    Markers marker{};
+    if (!GetMarker(marker)) {
+        return false;
+    }
+    if (marker != EOI) {
+        return Fail(DecodeErrorCode::kInvalidScan, "File does not end with proper marker");
+    }
+    return true;
+}
+
+size_t JpegReader::McuRowsLeft() const {
+    return mcu_h_ - current_mcu_row_;
+}
+
+size_t JpegReader::McuHeight() const {
+    return 8 * max_v_;
+}
+
+bool JpegReader::ReadSOS(Image& image, const DecodeOptions& options, DecodeStatus* status) {
+    TRACE_SPAN("scan");
+    if (!ReadSOSHeader()) {
+        return false;
+    }
+
+    if (options.roi.width && options.roi.height &&
+        (options.roi.x >= info_.width || options.roi.y >= info_.height)) {
+        return Fail(DecodeErrorCode::kInvalidHeader, "Region of interest is outside of the image");
+    }
+    DecodeRegion roi = ClipRegion(options.roi, info_.width, info_.height);
+    size_t memory = EstimateDecodeMemory(info_, roi).Sequential();
+    if (!CheckLimits(memory)) {
+        return false;
+    }
+    DECODE_STATS(stats_->peak_bytes = std::max(stats_->peak_bytes, memory));
+
+    image.SetSize(roi.width, roi.height);
+    image.SetComment(info_.comment);
+
+    size_t rows_decoded = 0;
+    bool ok = true;
+    while (ok && McuRowsLeft() > 0) {
+        size_t y_begin = current_mcu_row_ * McuHeight();
+        if (y_begin >= roi.y + roi.height) {
+            break;
+        }
+        size_t y_end = std::min(info_.height, y_begin + McuHeight());
+        if (y_end <= roi.y) {
+            ok = ReadMCURow(buffers_->band, 0, 0);
+            continue;
+        }
+        ok = ReadMCURow(buffers_->band, roi.x, roi.x + roi.width);
+        if (!ok) {
+            break;
+        }
+
+        DECODE_STATS_TIMER(output);
+        TRACE_SPAN("output");
+        y_end = std::min(y_end, roi.y + roi.height);
+        for (size_t y = std::max(y_begin, roi.y); y < y_end; ++y) {
+            auto row = buffers_->band.begin() + (y - y_begin) * info_.width + roi.x;
+            std::copy(row, row + roi.width, &image.GetPixel(y - roi.y, 0));
+        }
+        rows_decoded = y_end - roi.y;
     }
-}
\ No newline at end of file
+    if (ok && McuRowsLeft() == 0) {
+        ok = CheckEOI();
+    }
+
+    if (!ok) {
+        if (!options.allow_partial) {
+            return false;
+        }
+        DLOG(WARNING) << "Partial image: " << error_.message;
+
+        for (size_t y = rows_decoded; y < roi.height; ++y) {
+            for (size_t x = 0; x < roi.width; ++x) {
+                image.SetPixel(y, x, {128, 128, 128});
+            }
+        }
+        if (status) {
+            status->complete = false;
+            status->error = error_.message;
+        }
+    }
+
+    if (status) {
+        status->rows_decoded = rows_decoded;
+    }
+    DECODE_STATS({
+        std::streampos position = bit_reader_.GetState().position;
+        if (stats_start_ != std::streampos(-1) && position != std::streampos(-1)) {
+            stats_->bytes_consumed = position - stats_start_;
+        }
+    });
+    return true;
+}
+
+bool JpegReader::ReadCoefficients(JpegCoefficients& coefficients) {
+    if (!ReadSOSHeader()) {
+        return false;
+    }
+
+    size_t memory = EstimateDecodeMemory(info_, {0, 0, info_.width, info_.height}).coefficients;
+    if (!CheckLimits(memory)) {
+        return false;
+    }
+    DECODE_STATS(stats_->peak_bytes = std::max(stats_->peak_bytes, memory));
+
+    coefficients.info = info_;
+    coefficients.components.clear();
+    for (size_t channel = 1; channel <= scan_channels_; ++channel) {
+        const ChannelInfo& channel_info = channels_info_[channel];
+        if (!channel_info.quant) {
+            return Fail(DecodeErrorCode::kInvalidHeader, "DQT table with such idx does not exist");
+        }
+
+        ComponentCoefficients component;
+        component.info = {static_cast<uint8_t>(channel), channel_info.horizontal,
+                          channel_info.vertical, static_cast<uint8_t>(channel_info.dqt_table)};
+        component.width_in_blocks = mcu_w_ * channel_info.horizontal;
+        component.height_in_blocks = mcu_h_ * channel_info.vertical;
+        component.coefficients.resize(component.width_in_blocks * component.height_in_blocks * 64);
+        component.quant_table = *channel_info.quant;
+        coefficients.components.push_back(std::move(component));
+    }
+
+    for (size_t i = 0; i < mcu_h_; ++i) {
+        for (size_t j = 0; j < mcu_w_; ++j) {
+            for (size_t channel = 1; channel <= scan_channels_; ++channel) {
+                ComponentCoefficients& component = coefficients.components[channel - 1];
+                for (size_t h = 0; h < channels_info_[channel].vertical; ++h) {
+                    for (size_t v = 0; v < channels_info_[channel].horizontal; ++v) {
+                        size_t block_y = i * channels_info_[channel].vertical + h;
+                        size_t block_x = j * channels_info_[channel].horizontal + v;
+                        if (!ReadBlock(channel, component.Block(block_y, block_x))) {
+                            return false;
+                        }
+                    }
+                }
+            }
+            if (bit_reader_.Ended()) {
+                return Fail(DecodeErrorCode::kTruncated, "Unexpected end of input");
+            }
+        }
+        ++current_mcu_row_;
+    }
+
+    return CheckEOI();
+}
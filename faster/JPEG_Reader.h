@@ -1,11 +1,22 @@
+#pragma once
+
 #include "BitReader.h"
-#include "include/huffman.h"
+#include "BlockStats.h"
+#include "CountingResource.h"
+#include "Tables.h"
+#include "DecodeStatsTimer.h"
+#include "Trace.h"
 #include "include/fft.h"
-#include "include/decoder.h"
+#include "include/decode_error.h"
+#include "include/decode_options.h"
+#include "include/jpeg_info.h"
+#include "include/coefficients.h"
 #include <fft.h>
+#include <array>
 #include <cmath>
-
-using DQTTable = std::vector<std::vector<int>>;
+#include <cstdint>
+#include <memory_resource>
+#include <optional>
 
 enum Markers {
     SECTION_BEGIN_MARKER = 0xFF,
@@ -27,6 +38,11 @@ struct ChannelInfo {
     size_t dqt_table{};
     uint8_t dc_table_idx{};
     uint8_t ac_table_idx{};
+    // Tables used by the current scan, resolved by ReadSOSHeader. Null if
+    // there is no table with such idx.
+    const DQTTable* quant{};
+    const HuffmanTable* dc_table{};
+    const HuffmanTable* ac_table{};
 };
 
 struct ChannelHandler {
@@ -39,54 +55,284 @@ struct ChannelHandler {
     DctCalculator calc;
 };
 
+// Blocks of one MCU stored one after another: the channels in order, the
+// blocks of a channel by rows. The memory is kept when the MCU is reused.
 class MCU {
 public:
-    MCU();
+    using allocator_type = std::pmr::polymorphic_allocator<double>;
+
+    MCU() = default;
+
+    explicit MCU(const allocator_type& allocator) : data_(allocator) {
+    }
+
+    MCU(const MCU& other, const allocator_type& allocator)
+        : data_(other.data_, allocator), offsets_(other.offsets_), horizontal_(other.horizontal_) {
+    }
+
+    MCU(MCU&& other, const allocator_type& allocator)
+        : data_(std::move(other.data_), allocator),
+          offsets_(other.offsets_),
+          horizontal_(other.horizontal_) {
+    }
+
+    MCU(const MCU&) = default;
+    MCU(MCU&&) = default;
+    MCU& operator=(const MCU&) = default;
+    MCU& operator=(MCU&&) = default;
+
+    // Lays out the blocks of the channels 1..channels_cnt.
+    void Resize(const std::vector<ChannelInfo>& channels_info, size_t channels_cnt);
+
+    double* Block(size_t channel, size_t h, size_t v) {
+        return data_.data() + (offsets_[channel] + h * horizontal_[channel] + v) * 64;
+    }
+
+    const double* Block(size_t channel, size_t h, size_t v) const {
+        return data_.data() + (offsets_[channel] + h * horizontal_[channel] + v) * 64;
+    }
+
+private:
+    std::pmr::vector<double> data_{};
+    std::array<size_t, 4> offsets_{};
+    std::array<size_t, 4> horizontal_{};
+};
+
+// Thrown when the image breaks DecodeLimits.
+class LimitExceeded : public std::invalid_argument {
+public:
+    using std::invalid_argument::invalid_argument;
+};
+
+// An empty region becomes the whole image, the rest are cut by its borders.
+DecodeRegion ClipRegion(DecodeRegion roi, size_t width, size_t height);
 
-    using Block = std::vector<std::vector<double>>;
+// Bytes taken by the buffers of decoding the image, which DecodeLimits and
+// the memory budgets are checked against.
+struct DecodeMemory {
+    // Pixels of the region with the headers of its rows.
+    size_t image = 0;
+    // Band of MCU rows of the whole width which the pixels are converted to.
+    size_t band = 0;
+    // Samples of the MCUs of one row.
+    size_t row_mcus = 0;
+    // Quantized coefficients of the whole image, for decoding without a band.
+    size_t coefficients = 0;
+    // Heap allocations made for the image, the band and the MCUs.
+    size_t allocations = 0;
 
-    std::vector<std::vector<std::vector<Block>>> mcu_{};
+    // Peak of the decoding row by row.
+    size_t Sequential() const {
+        return image + band + row_mcus;
+    }
 };
 
+// |roi| has to be clipped to the image.
+DecodeMemory EstimateDecodeMemory(const JpegInfo& info, DecodeRegion roi);
+
+// Throws the exception matching the code: EndOfInput for the truncated input,
+// LimitExceeded for the limits, std::invalid_argument for the rest.
+[[noreturn]] void ThrowDecodeError(const DecodeError& error);
+
+// The reader does not throw on the errors of the input: the methods return
+// false and keep the error, see GetError. The decoding has to stop then.
+
 class JpegReader {
 public:
+    // Everything needed to continue reading from some position of the input.
+    struct Checkpoint {
+        BitReader::State bit_reader_state{};
+        std::array<int, 4> dc_coeffs{};
+        size_t mcu_row{};
+        // MCU of the row to be read next.
+        size_t mcu{};
+    };
+
     explicit JpegReader(std::istream& istream);
 
-    Markers GetMarker();
+    // Starts reading the new image. The IDCT plan and the buffers are kept.
+    void Reset(std::istream& istream);
+
+    bool GetMarker(Markers& marker);
 
-    size_t GetLength();
+    // Reads the length of the section and returns the bytes left in it.
+    bool GetLength(size_t& length);
 
     int GetNumber(size_t length, bool skip_ff = false);
 
-    void ReadComment(Image& image);
+    bool ReadComment();
+
+    bool ReadApp();
+
+    bool ReadDQT();
+
+    bool ReadHT();
+
+    bool ReadSOF0();
 
-    void ReadApp();
+    // Tables used by the scan if the image does not define them itself.
+    void SetTables(std::shared_ptr<const JpegTables> tables);
 
-    void ReadDQT();
+    // The size is checked by ReadSOF0, the rest by ReadSOS and
+    // ReadCoefficients before the allocation.
+    void SetLimits(const DecodeLimits& limits);
 
-    void ReadHT();
+    // Counts the statistics of the image into |stats| if it is not null, with
+    // the hardware counters of the stages if |perf_counters| is set.
+    void SetStats(DecodeStats* stats, bool perf_counters = false);
 
-    void ReadSOF0(Image& image);
+    // The buffers of the scan are allocated from |resource|, or from the
+    // default resource if it is null. The buffers taken from the previous
+    // resource are freed, so it has to be alive at the time.
+    void SetMemoryResource(std::pmr::memory_resource* resource);
 
-    void ReadSOS(Image& image);
+    std::pmr::memory_resource* GetMemoryResource() const;
 
-    RGB GetRGB(double y, double cb, double cr);
+    // Frees the buffers of the scan if they take more than |max_bytes|, so
+    // that a reader kept for small images doesn't hold on to a big one.
+    void TrimBuffers(size_t max_bytes);
 
-    MCU ReadMCU(size_t channels_cnt);
+    // Adds the histograms of the blocks to |block_stats| if it is not null.
+    void SetBlockStats(BlockStats* block_stats);
 
-    void HandleMCU(MCU& mcu, size_t channels_cnt);
+    // Reads a tables-only stream: SOI, DQT and DHT sections and EOI. Returns
+    // null on an error.
+    std::shared_ptr<const JpegTables> ReadTables();
 
-    std::vector<std::vector<RGB>> ToRGB(MCU& mcu, size_t channels_cnt);
+    // Reads all the sections up to and including the SOS marker.
+    bool ReadHeaders();
+
+    // Reads the next section, |sos| is set if it is SOS, in which case only
+    // the marker is read.
+    bool ReadSection(bool& sos);
+
+    Checkpoint SaveCheckpoint();
+
+    // Rewinds the input to the checkpoint and clears the error. Sections read
+    // after it have to be read again.
+    void RestoreCheckpoint(const Checkpoint& checkpoint);
+
+    // With DecodeOptions::allow_partial the errors of the scan are reported
+    // in |status| and the method succeeds.
+    bool ReadSOS(Image& image, const DecodeOptions& options = {}, DecodeStatus* status = nullptr);
+
+    bool ReadSOSHeader();
+
+    // Decodes the next row of MCUs into |band|, which holds McuHeight() rows
+    // of the image one after another. Only the MCUs covering the columns
+    // [x_begin, x_end) are reconstructed, the rest of the band is left as is.
+    // If |progress| is not null, it is saved after every MCU, so that a row
+    // stopped by the end of the input is continued from the last complete MCU
+    // once the checkpoint is restored.
+    bool ReadMCURow(std::pmr::vector<RGB>& band, size_t x_begin = 0, size_t x_end = SIZE_MAX,
+                    Checkpoint* progress = nullptr);
+
+    bool CheckEOI();
+
+    // Reads the EOI marker after the scan, so that the input can go on with
+    // the next image.
+    bool ReadEOI();
+
+    size_t McuRowsLeft() const;
+
+    size_t McuHeight() const;
+
+    static RGB GetRGB(double y, double cb, double cr);
+
+    // Reads the quantized coefficients of the next block of the channel in
+    // the natural order. The end of the input is not checked.
+    bool ReadBlock(size_t channel, int16_t* coefficients);
+
+    // Reads the next MCU into |mcu|, which does not allocate once it was
+    // used for an MCU of this image.
+    bool ReadMCU(size_t channels_cnt, MCU& mcu);
+
+    // Reads the MCU without reconstructing it.
+    bool SkipMCU(size_t channels_cnt);
+
+    bool ReadCoefficients(JpegCoefficients& coefficients);
+
+    bool HandleMCU(MCU& mcu, size_t channels_cnt);
+
+    // Writes the first |columns| columns of the MCU's pixels to |out|, whose
+    // rows are |stride| pixels apart.
+    void ToRGB(const MCU& mcu, size_t channels_cnt, RGB* out, size_t stride, size_t columns);
+
+    // Fails if decoding the scan takes more than |memory| bytes or breaks
+    // the other limits.
+    bool CheckLimits(size_t memory);
+
+    const JpegInfo& GetInfo() const;
+
+    // The error which stopped the reader, valid after a method returned
+    // false.
+    const DecodeError& GetError() const;
 
 private:
+    // Keeps the error and returns false. Any error after the end of the input
+    // is reported as the input being truncated, the data read past the end
+    // is not real.
+    bool Fail(DecodeErrorCode code, const char* message);
+
+    bool Fail(DecodeErrorCode code, const char* message, size_t offset);
+
     BitReader bit_reader_;
-    std::vector<DQTTable> dqt_tables_{};
+    JpegTables tables_{};
+    std::shared_ptr<const JpegTables> shared_tables_{};
+    DecodeLimits limits_{};
+    DecodeStats* stats_{};
+    std::streampos stats_start_{};
+    bool perf_counters_ = false;
+    std::unique_ptr<PerfEventGroup> perf_{};
+    BlockStats* block_stats_{};
     std::vector<ChannelInfo> channels_info_{};
-    std::vector<HuffmanTree> dc_h_ts_{};
-    std::vector<HuffmanTree> ac_h_ts_{};
     uint8_t max_h_{};
     uint8_t max_v_{};
-    ChannelHandler ch_handler_;
+    std::unique_ptr<ChannelHandler> ch_handler_{};
+    // MCU of the current row to be read next, the MCUs before it are kept in
+    // the row buffer.
     size_t current_mcu_{};
-    std::vector<int> dc_coeffs_{};
-};
\ No newline at end of file
+    bool soi_read_ = false;
+    size_t scan_channels_{};
+    size_t blocks_per_mcu_{};
+    size_t mcu_w_{};
+    size_t mcu_h_{};
+    size_t current_mcu_row_{};
+    std::array<int, 4> dc_coeffs_{};
+    JpegInfo info_{};
+    // Values of the DHT table being read.
+    std::vector<uint8_t> ht_values_{};
+    DecodeError error_{};
+
+    struct ScanBuffers {
+        explicit ScanBuffers(std::pmr::memory_resource* resource)
+            : band(resource), row_mcus(resource) {
+        }
+
+        std::pmr::vector<RGB> band;
+        // MCUs of the row being decoded.
+        std::pmr::vector<MCU> row_mcus;
+    };
+    // Never empty, optional only to change the allocator.
+    std::optional<ScanBuffers> buffers_{std::in_place, std::pmr::get_default_resource()};
+};
+
+// Gives the reader the memory resource of the call, and back the default one
+// with the buffers freed at the end of the scope, while the resource is still
+// alive. If |stats| are given, the allocations from the resource are counted
+// into them through CountingResource.
+class MemoryResourceScope {
+public:
+    MemoryResourceScope(JpegReader& reader, std::pmr::memory_resource* resource,
+                        DecodeStats* stats = nullptr);
+
+    MemoryResourceScope(const MemoryResourceScope&) = delete;
+    MemoryResourceScope& operator=(const MemoryResourceScope&) = delete;
+
+    ~MemoryResourceScope();
+
+private:
+    JpegReader& reader_;
+    bool release_;
+    std::optional<AllocationCountScope> count_scope_{};
+};
@@ -0,0 +1,33 @@
+#include <jpeg_decoder.h>
+
+#include "DecodeWithReader.h"
+#include "JPEG_Reader.h"
+
+class JpegDecoder::Impl {
+public:
+    std::unique_ptr<JpegReader> reader{};
+};
+
+JpegDecoder::JpegDecoder() : impl_(std::make_unique<Impl>()) {
+}
+
+Image JpegDecoder::Decode(std::istream& input, const DecodeOptions& options,
+                          DecodeStatus* status) {
+    if (impl_->reader) {
+        impl_->reader->Reset(input);
+    } else {
+        impl_->reader = std::make_unique<JpegReader>(input);
+    }
+
+    Result<Image, DecodeError> result = DecodeWithReader(*impl_->reader, options, status);
+    if (!result) {
+        ThrowDecodeError(result.Error());
+    }
+    return std::move(result.Value());
+}
+
+JpegDecoder::JpegDecoder(JpegDecoder&&) = default;
+
+JpegDecoder& JpegDecoder::operator=(JpegDecoder&&) = default;
+
+JpegDecoder::~JpegDecoder() = default;
@@ -0,0 +1,114 @@
+#include <stream_decoder.h>
+#include <coefficients.h>
+
+#include "JPEG_Reader.h"
+#include "Trace.h"
+#include "WorkStealingPool.h"
+
+#include <future>
+#include <optional>
+#include <utility>
+
+class JpegStreamDecoder::Impl {
+public:
+    Impl(std::istream& in_input, const DecodeOptions& in_options)
+        : input(in_input), options(in_options) {
+    }
+
+    std::optional<JpegCoefficients> ReadFrame() {
+        // Anything between the frames is skipped, as some encoders leave
+        // padding after EOI.
+        int byte = 0;
+        while ((byte = input.get()) != std::istream::traits_type::eof()) {
+            if (byte == SECTION_BEGIN_MARKER && input.peek() == SOI) {
+                input.unget();
+                break;
+            }
+        }
+        if (input.eof()) {
+            return std::nullopt;
+        }
+
+        if (reader) {
+            reader->Reset(input);
+        } else {
+            reader = std::make_unique<JpegReader>(input);
+        }
+
+        TRACE_SPAN("frame");
+        reader->SetTables(options.tables);
+        reader->SetLimits(options.limits);
+        reader->SetStats(options.stats, options.perf_counters);
+        if (!reader->ReadHeaders()) {
+            ThrowDecodeError(reader->GetError());
+        }
+        // The frame is rendered while the coefficients of the next one are
+        // read, so the image is checked together with them.
+        const JpegInfo& info = reader->GetInfo();
+        DecodeMemory memory =
+            EstimateDecodeMemory(info, ClipRegion(options.roi, info.width, info.height));
+        JpegCoefficients coefficients;
+        if (!reader->CheckLimits(memory.image + memory.coefficients) ||
+            !reader->ReadCoefficients(coefficients) || !reader->ReadEOI()) {
+            ThrowDecodeError(reader->GetError());
+        }
+        return coefficients;
+    }
+
+    void StartRendering(JpegCoefficients coefficients) {
+        auto task = std::make_shared<std::packaged_task<Image()>>(
+            [coefficients = std::move(coefficients), roi = options.roi]() mutable {
+                TRACE_SPAN("render");
+                return DecodedCoefficients(std::move(coefficients))
+                    .Render(1, PixelFormat::kRgb, roi);
+            });
+        rendering = task->get_future();
+        worker.Submit([task] { (*task)(); });
+    }
+
+    std::istream& input;
+    DecodeOptions options;
+    std::unique_ptr<JpegReader> reader{};
+    std::future<Image> rendering{};
+    std::exception_ptr error{};
+    // Kept for the whole stream, the frames are rendered one at a time.
+    WorkStealingPool worker{1};
+};
+
+JpegStreamDecoder::JpegStreamDecoder(std::istream& input, const DecodeOptions& options)
+    : impl_(std::make_unique<Impl>(input, options)) {
+}
+
+bool JpegStreamDecoder::Next(Image& frame) {
+    if (impl_->error) {
+        std::rethrow_exception(std::exchange(impl_->error, nullptr));
+    }
+
+    if (!impl_->rendering.valid()) {
+        std::optional<JpegCoefficients> first = impl_->ReadFrame();
+        if (!first) {
+            return false;
+        }
+        impl_->StartRendering(std::move(*first));
+    }
+
+    std::optional<JpegCoefficients> next;
+    try {
+        next = impl_->ReadFrame();
+    } catch (...) {
+        // The frame being rendered is still good, the error is reported by
+        // the next call.
+        impl_->error = std::current_exception();
+    }
+    frame = impl_->rendering.get();
+    if (next) {
+        impl_->StartRendering(std::move(*next));
+    }
+    return true;
+}
+
+JpegStreamDecoder::JpegStreamDecoder(JpegStreamDecoder&&) = default;
+
+JpegStreamDecoder& JpegStreamDecoder::operator=(JpegStreamDecoder&&) = default;
+
+JpegStreamDecoder::~JpegStreamDecoder() = default;
@@ -0,0 +1,136 @@
+#include "PerfEvents.h"
+
+#include <glog/logging.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include <cstring>
+
+namespace {
+#ifdef __linux__
+struct EventConfig {
+    uint32_t type;
+    uint64_t config;
+};
+
+constexpr uint64_t CacheReadMisses(uint64_t cache) {
+    return cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+}
+
+// Same order as the fields of PerfCounters, the first one leads the group.
+constexpr EventConfig kEventConfigs[] = {
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+    {PERF_TYPE_HW_CACHE, CacheReadMisses(PERF_COUNT_HW_CACHE_L1D)},
+    {PERF_TYPE_HW_CACHE, CacheReadMisses(PERF_COUNT_HW_CACHE_LL)},
+};
+
+int OpenEvent(const EventConfig& event, int group) {
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = event.type;
+    attr.config = event.config;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format =
+        PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, group, 0));
+}
+#endif
+
+// Estimate of the events over the whole time the group was enabled, when it was
+// counting only for |running| of it.
+uint64_t Scale(uint64_t value, uint64_t enabled, uint64_t running) {
+    if (running == enabled) {
+        return value;
+    }
+    return static_cast<uint64_t>(static_cast<double>(value) * enabled / running);
+}
+
+// Scaled values don't have to grow.
+uint64_t Difference(uint64_t begin, uint64_t end) {
+    return end > begin ? end - begin : 0;
+}
+
+uint64_t* Field(PerfCounters& counters, size_t index) {
+    uint64_t* fields[] = {&counters.cycles, &counters.instructions, &counters.branch_misses,
+                          &counters.l1d_misses, &counters.llc_misses};
+    return fields[index];
+}
+}  // namespace
+
+PerfEventGroup::PerfEventGroup() {
+    fds_.fill(-1);
+#ifdef __linux__
+    for (size_t i = 0; i < kEvents; ++i) {
+        fds_[i] = OpenEvent(kEventConfigs[i], leader_);
+        if (i == 0) {
+            leader_ = fds_[0];
+            if (leader_ < 0) {
+                DLOG(INFO) << "perf_event_open is not permitted";
+                return;
+            }
+        }
+    }
+#endif
+}
+
+PerfEventGroup::~PerfEventGroup() {
+#ifdef __linux__
+    for (int fd : fds_) {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+#endif
+}
+
+bool PerfEventGroup::IsOpen() const {
+    return leader_ >= 0;
+}
+
+bool PerfEventGroup::CountsCallingThread() const {
+    return thread_ == std::this_thread::get_id();
+}
+
+PerfCounters PerfEventGroup::Read() const {
+    PerfCounters counters;
+#ifdef __linux__
+    if (!IsOpen()) {
+        return counters;
+    }
+    // The number of the events, the time the group was enabled and the time
+    // it was counting, then the values in the order the events were added to
+    // the group.
+    uint64_t values[kEvents + 3] = {};
+    if (read(leader_, values, sizeof(values)) < static_cast<ssize_t>(3 * sizeof(uint64_t))) {
+        return counters;
+    }
+    uint64_t enabled = values[1];
+    uint64_t running = values[2];
+    if (running == 0) {
+        return counters;
+    }
+    size_t value = 3;
+    for (size_t i = 0; i < kEvents && value < values[0] + 3; ++i) {
+        if (fds_[i] >= 0) {
+            *Field(counters, i) = Scale(values[value++], enabled, running);
+        }
+    }
+#endif
+    return counters;
+}
+
+void AddPerfCounters(PerfCounters& total, const PerfCounters& begin, const PerfCounters& end) {
+    total.cycles += Difference(begin.cycles, end.cycles);
+    total.instructions += Difference(begin.instructions, end.instructions);
+    total.branch_misses += Difference(begin.branch_misses, end.branch_misses);
+    total.l1d_misses += Difference(begin.l1d_misses, end.l1d_misses);
+    total.llc_misses += Difference(begin.llc_misses, end.llc_misses);
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <perf_counters.h>
+
+#include <array>
+#include <cstddef>
+#include <thread>
+
+// Group of hardware counters of the calling thread, read together through
+// perf_event_open. The counters which the kernel or the CPU don't provide stay
+// zero, all of them do if perf events are not permitted or not on Linux.
+class PerfEventGroup {
+public:
+    PerfEventGroup();
+
+    PerfEventGroup(const PerfEventGroup&) = delete;
+    PerfEventGroup& operator=(const PerfEventGroup&) = delete;
+
+    ~PerfEventGroup();
+
+    bool IsOpen() const;
+
+    // Whether the group counts the calling thread, which opened it.
+    bool CountsCallingThread() const;
+
+    // Values counted since the group was opened. When the kernel multiplexes
+    // the counters the values are scaled by the time the group was counting.
+    PerfCounters Read() const;
+
+private:
+    static constexpr size_t kEvents = 5;
+
+    std::thread::id thread_ = std::this_thread::get_id();
+    int leader_ = -1;
+    // Descriptors in the order of the PerfCounters fields, -1 if not opened.
+    std::array<int, kEvents> fds_{};
+};
+
+// Adds |end| - |begin| to |total|.
+void AddPerfCounters(PerfCounters& total, const PerfCounters& begin, const PerfCounters& end);
@@ -0,0 +1,161 @@
+#include <push_decoder.h>
+
+#include "JPEG_Reader.h"
+
+#include <algorithm>
+#include <streambuf>
+
+namespace {
+// Input buffer that is appended to as the data arrives. Positions are counted
+// from the beginning of the whole input, so the bytes that will not be read
+// again can be dropped without breaking the saved checkpoints.
+class ChunkBuffer : public std::streambuf {
+public:
+    void Append(const char* data, size_t size) {
+        size_t offset = gptr() - eback();
+        data_.insert(data_.end(), data, data + size);
+        setg(data_.data(), data_.data() + offset, data_.data() + data_.size());
+    }
+
+    // Drops the bytes before |position| if it frees a noticeable part of the
+    // buffer.
+    void Discard(size_t position) {
+        size_t count = position - base_;
+        if (count == 0 || count < data_.size() / 2) {
+            return;
+        }
+        size_t offset = gptr() - eback() - count;
+        data_.erase(data_.begin(), data_.begin() + count);
+        base_ = position;
+        setg(data_.data(), data_.data() + offset, data_.data() + data_.size());
+    }
+
+    bool Empty() const {
+        return data_.empty();
+    }
+
+protected:
+    pos_type seekoff(off_type off, std::ios_base::seekdir dir,
+                     std::ios_base::openmode which) override {
+        off_type position = 0;
+        if (dir == std::ios_base::beg) {
+            position = off;
+        } else if (dir == std::ios_base::cur) {
+            position = base_ + (gptr() - eback()) + off;
+        } else {
+            position = base_ + data_.size() + off;
+        }
+        return seekpos(position, which);
+    }
+
+    pos_type seekpos(pos_type position, std::ios_base::openmode which) override {
+        off_type offset = static_cast<off_type>(position) - static_cast<off_type>(base_);
+        if (!(which & std::ios_base::in) || offset < 0 ||
+            offset > static_cast<off_type>(data_.size())) {
+            return pos_type(off_type(-1));
+        }
+        setg(data_.data(), data_.data() + offset, data_.data() + data_.size());
+        return position;
+    }
+
+private:
+    std::vector<char> data_{};
+    size_t base_ = 0;
+};
+}  // namespace
+
+class PushDecoder::Impl {
+public:
+    Impl() : stream(&buffer) {
+    }
+
+    ChunkBuffer buffer{};
+    std::istream stream;
+    std::unique_ptr<JpegReader> reader{};
+    JpegReader::Checkpoint checkpoint{};
+    bool header_ready = false;
+    bool done = false;
+    std::pmr::vector<RGB> band{};
+    size_t next_row = 0;
+};
+
+PushDecoder::PushDecoder() : impl_(std::make_unique<Impl>()) {
+}
+
+PushProgress PushDecoder::Feed(const char* data, size_t size) {
+    PushProgress progress;
+    if (impl_->done) {
+        progress.done = true;
+        progress.header_ready = true;
+        progress.bytes_consumed = std::streamoff(impl_->checkpoint.bit_reader_state.position);
+        return progress;
+    }
+
+    impl_->buffer.Append(data, size);
+    if (!impl_->reader) {
+        if (impl_->buffer.Empty()) {
+            return progress;
+        }
+        impl_->reader = std::make_unique<JpegReader>(impl_->stream);
+        impl_->checkpoint = impl_->reader->SaveCheckpoint();
+    }
+
+    JpegReader& reader = *impl_->reader;
+    progress.first_row = impl_->next_row;
+    bool ok = true;
+    while (ok && !impl_->header_ready) {
+        bool sos = false;
+        ok = reader.ReadSection(sos) && (!sos || reader.ReadSOSHeader());
+        if (ok) {
+            impl_->header_ready = sos;
+            impl_->checkpoint = reader.SaveCheckpoint();
+        }
+    }
+
+    while (ok && reader.McuRowsLeft() > 0) {
+        // The checkpoint follows the MCUs, the ones read before the end of
+        // the chunk are not read again.
+        ok = reader.ReadMCURow(impl_->band, 0, SIZE_MAX, &impl_->checkpoint);
+        if (ok) {
+            const JpegInfo& info = reader.GetInfo();
+            impl_->buffer.Discard(std::streamoff(impl_->checkpoint.bit_reader_state.position));
+
+            size_t rows = std::min(info.height - impl_->next_row, reader.McuHeight());
+            progress.rows.insert(progress.rows.end(), impl_->band.begin(),
+                                 impl_->band.begin() + rows * info.width);
+            impl_->next_row += rows;
+        }
+    }
+
+    if (ok && reader.CheckEOI()) {
+        impl_->done = true;
+    } else if (reader.GetError().code == DecodeErrorCode::kTruncated) {
+        // The rest comes with the next chunks.
+        reader.RestoreCheckpoint(impl_->checkpoint);
+    } else {
+        ThrowDecodeError(reader.GetError());
+    }
+
+    progress.header_ready = impl_->header_ready;
+    progress.done = impl_->done;
+    progress.bytes_consumed = std::streamoff(impl_->checkpoint.bit_reader_state.position);
+    progress.rows_count = impl_->next_row - progress.first_row;
+    return progress;
+}
+
+const JpegInfo& PushDecoder::GetInfo() const {
+    if (!impl_->header_ready) {
+        throw std::logic_error("Header was not read yet");
+    }
+    return impl_->reader->GetInfo();
+}
+
+bool PushDecoder::Done() const {
+    return impl_->done;
+}
+
+PushDecoder::PushDecoder(PushDecoder&&) = default;
+
+PushDecoder& PushDecoder::operator=(PushDecoder&&) = default;
+
+PushDecoder::~PushDecoder() = default;
@@ -0,0 +1,70 @@
+#include <scanline_decoder.h>
+
+#include "JPEG_Reader.h"
+
+#include <algorithm>
+
+class ScanlineDecoder::Impl {
+public:
+    explicit Impl(std::istream& input) : reader(input) {
+    }
+
+    JpegReader reader;
+    bool header_read = false;
+    std::pmr::vector<RGB> band{};
+    size_t band_begin = 0;
+    size_t band_end = 0;
+    size_t output_scanline = 0;
+};
+
+ScanlineDecoder::ScanlineDecoder(std::istream& input) : impl_(std::make_unique<Impl>(input)) {
+}
+
+const JpegInfo& ScanlineDecoder::ReadHeader() {
+    if (impl_->header_read) {
+        throw std::logic_error("Header was already read");
+    }
+
+    if (!impl_->reader.ReadHeaders() || !impl_->reader.ReadSOSHeader()) {
+        ThrowDecodeError(impl_->reader.GetError());
+    }
+    impl_->header_read = true;
+    return impl_->reader.GetInfo();
+}
+
+size_t ScanlineDecoder::ReadRows(RGB* dst, size_t max_rows) {
+    if (!impl_->header_read) {
+        throw std::logic_error("ReadHeader has to be called first");
+    }
+
+    const JpegInfo& info = impl_->reader.GetInfo();
+    size_t written = 0;
+    while (written < max_rows && impl_->output_scanline < info.height) {
+        if (impl_->output_scanline == impl_->band_end) {
+            if (!impl_->reader.ReadMCURow(impl_->band) ||
+                (impl_->reader.McuRowsLeft() == 0 && !impl_->reader.CheckEOI())) {
+                ThrowDecodeError(impl_->reader.GetError());
+            }
+            impl_->band_begin = impl_->band_end;
+            impl_->band_end = std::min(info.height, impl_->band_begin + impl_->reader.McuHeight());
+        }
+
+        size_t rows = std::min(max_rows - written, impl_->band_end - impl_->output_scanline);
+        auto from = impl_->band.begin() + (impl_->output_scanline - impl_->band_begin) * info.width;
+        std::copy(from, from + rows * info.width, dst + written * info.width);
+        written += rows;
+        impl_->output_scanline += rows;
+    }
+
+    return written;
+}
+
+size_t ScanlineDecoder::OutputScanline() const {
+    return impl_->output_scanline;
+}
+
+ScanlineDecoder::ScanlineDecoder(ScanlineDecoder&&) = default;
+
+ScanlineDecoder& ScanlineDecoder::operator=(ScanlineDecoder&&) = default;
+
+ScanlineDecoder::~ScanlineDecoder() = default;
@@ -0,0 +1,163 @@
+#include "Tables.h"
+
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+
+namespace {
+struct HuffmanSpec {
+    std::array<uint8_t, 16> code_lengths;
+    std::array<uint8_t, 162> values;
+    size_t values_count;
+};
+
+constexpr HuffmanSpec kDCLuminance = {
+    {0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0}, {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11}, 12};
+
+constexpr HuffmanSpec kDCChrominance = {
+    {0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0}, {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11}, 12};
+
+constexpr HuffmanSpec kACLuminance = {
+    {0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7d},
+    {0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61,
+     0x07, 0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xa1, 0x08, 0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52,
+     0xd1, 0xf0, 0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0a, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x25,
+     0x26, 0x27, 0x28, 0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45,
+     0x46, 0x47, 0x48, 0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64,
+     0x65, 0x66, 0x67, 0x68, 0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x83,
+     0x84, 0x85, 0x86, 0x87, 0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99,
+     0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6,
+     0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3,
+     0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8,
+     0xe9, 0xea, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8, 0xf9, 0xfa},
+    162};
+
+constexpr HuffmanSpec kACChrominance = {
+    {0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 0x77},
+    {0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21, 0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61,
+     0x71, 0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91, 0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33,
+     0x52, 0xf0, 0x15, 0x62, 0x72, 0xd1, 0x0a, 0x16, 0x24, 0x34, 0xe1, 0x25, 0xf1, 0x17, 0x18,
+     0x19, 0x1a, 0x26, 0x27, 0x28, 0x29, 0x2a, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44,
+     0x45, 0x46, 0x47, 0x48, 0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63,
+     0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a,
+     0x82, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97,
+     0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4,
+     0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca,
+     0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7,
+     0xe8, 0xe9, 0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8, 0xf9, 0xfa},
+    162};
+
+std::shared_ptr<const HuffmanTable> MakeTable(const HuffmanSpec& spec) {
+    return HuffmanTable::Get(spec.code_lengths, std::vector<uint8_t>(spec.values.begin(),
+                                                                     spec.values.begin() +
+                                                                         spec.values_count));
+}
+}  // namespace
+
+HuffmanTable::HuffmanTable(const std::array<uint8_t, 16>& code_lengths,
+                           const std::vector<uint8_t>& values)
+    : code_lengths_(code_lengths), values_(values) {
+    int32_t code = 0;
+    int32_t value_idx = 0;
+    for (size_t length = 1; length <= 16; ++length) {
+        uint8_t count = code_lengths[length - 1];
+        if (count == 0) {
+            max_code_[length] = -1;
+        } else {
+            min_code_[length] = code;
+            first_value_[length] = value_idx;
+            code += count;
+            value_idx += count;
+            max_code_[length] = code - 1;
+        }
+        if (code > (1 << length)) {
+            throw std::invalid_argument("Incorrect code lengths");
+        }
+        code <<= 1;
+    }
+
+    if (static_cast<size_t>(value_idx) != values_.size()) {
+        throw std::invalid_argument("Incorrect values");
+    }
+}
+
+bool HuffmanTable::Valid(const std::array<uint8_t, 16>& code_lengths) {
+    int32_t code = 0;
+    for (size_t length = 1; length <= 16; ++length) {
+        code += code_lengths[length - 1];
+        if (code > (1 << length)) {
+            return false;
+        }
+        code <<= 1;
+    }
+    return true;
+}
+
+bool HuffmanTable::Matches(const std::array<uint8_t, 16>& code_lengths,
+                           const std::vector<uint8_t>& values) const {
+    return code_lengths_ == code_lengths && values_ == values;
+}
+
+std::shared_ptr<const HuffmanTable> HuffmanTable::Get(const std::array<uint8_t, 16>& code_lengths,
+                                                      const std::vector<uint8_t>& values) {
+    // Images from one source repeat the same few tables, so the last tables of
+    // the thread are looked through before taking the lock.
+    thread_local std::array<std::shared_ptr<const HuffmanTable>, 8> recent;
+    thread_local size_t next_recent = 0;
+    for (const std::shared_ptr<const HuffmanTable>& table : recent) {
+        if (table && table->Matches(code_lengths, values)) {
+            return table;
+        }
+    }
+
+    static std::mutex mutex;
+    static std::unordered_map<std::string, std::weak_ptr<const HuffmanTable>> cache;
+
+    std::string key(code_lengths.begin(), code_lengths.end());
+    key.append(values.begin(), values.end());
+
+    std::lock_guard lock(mutex);
+    std::shared_ptr<const HuffmanTable> table = cache[key].lock();
+    if (!table) {
+        table = std::make_shared<const HuffmanTable>(code_lengths, values);
+        // Tables nobody holds are dropped once in a while.
+        if (cache.size() > 256) {
+            for (auto it = cache.begin(); it != cache.end();) {
+                it = it->second.expired() ? cache.erase(it) : std::next(it);
+            }
+        }
+        cache[key] = table;
+    }
+    recent[next_recent++ % recent.size()] = table;
+    return table;
+}
+
+bool HuffmanTable::Decode(BitReader& bit_reader, uint8_t& value, size_t* code_length) const {
+    int32_t code = bit_reader.GetNextBit(true);
+    size_t length = 1;
+    while (code > max_code_[length]) {
+        if (length == 16) {
+            return false;
+        }
+        code = (code << 1) | bit_reader.GetNextBit(true);
+        ++length;
+    }
+    if (code_length) {
+        *code_length = length;
+    }
+    value = values_[first_value_[length] + code - min_code_[length]];
+    return true;
+}
+
+std::shared_ptr<const HuffmanTable> GetDefaultDCTable(size_t idx) {
+    static const std::shared_ptr<const HuffmanTable> kTables[] = {MakeTable(kDCLuminance),
+                                                                   MakeTable(kDCChrominance)};
+    return idx < 2 ? kTables[idx] : nullptr;
+}
+
+std::shared_ptr<const HuffmanTable> GetDefaultACTable(size_t idx) {
+    static const std::shared_ptr<const HuffmanTable> kTables[] = {MakeTable(kACLuminance),
+                                                                   MakeTable(kACChrominance)};
+    return idx < 2 ? kTables[idx] : nullptr;
+}
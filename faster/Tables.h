@@ -0,0 +1,59 @@
+#pragma once
+
+#include "BitReader.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <vector>
+
+// Quantization table in the natural order.
+using DQTTable = std::array<uint16_t, 64>;
+
+// Canonical Huffman decoder of the DHT table (JPEG F.2.2.3). It has no state,
+// so one table can be shared by any number of readers and threads.
+class HuffmanTable {
+public:
+    // code_lengths[i] is the number of codes of length i + 1, values go in
+    // the order of the codes.
+    HuffmanTable(const std::array<uint8_t, 16>& code_lengths, const std::vector<uint8_t>& values);
+
+    // Whether the code lengths fit into 16 bits, which the constructor
+    // requires.
+    static bool Valid(const std::array<uint8_t, 16>& code_lengths);
+
+    // Returns the table built from these code lengths and values. Equal
+    // tables are built only once and shared while anyone holds them.
+    static std::shared_ptr<const HuffmanTable> Get(const std::array<uint8_t, 16>& code_lengths,
+                                                   const std::vector<uint8_t>& values);
+
+    bool Matches(const std::array<uint8_t, 16>& code_lengths,
+                 const std::vector<uint8_t>& values) const;
+
+    // Stores the value of the next code to |value| and its length to
+    // |code_length| if it is not null. Returns false if there is no such code.
+    bool Decode(BitReader& bit_reader, uint8_t& value, size_t* code_length = nullptr) const;
+
+private:
+    std::array<uint8_t, 16> code_lengths_;
+    std::vector<uint8_t> values_;
+    // For every length: the first and the last code of this length and the
+    // index of the first code's value, max_code is -1 if there are no codes.
+    std::array<int32_t, 17> min_code_{};
+    std::array<int32_t, 17> max_code_{};
+    std::array<int32_t, 17> first_value_{};
+};
+
+// Standard Huffman tables from Annex K.3, which are used by the streams
+// without DHT sections. Index 0 is for luminance, 1 for chrominance.
+std::shared_ptr<const HuffmanTable> GetDefaultDCTable(size_t idx);
+std::shared_ptr<const HuffmanTable> GetDefaultACTable(size_t idx);
+
+// Tables defined by the DQT and DHT sections, indexed by the table id.
+struct JpegTables {
+    std::vector<std::optional<DQTTable>> quant{};
+    std::vector<std::shared_ptr<const HuffmanTable>> dc{};
+    std::vector<std::shared_ptr<const HuffmanTable>> ac{};
+};
@@ -0,0 +1,120 @@
+#include <trace.h>
+
+#include "Trace.h"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace {
+struct TraceEvent {
+    const char* name;
+    int64_t begin_ns;
+    int64_t end_ns;
+};
+
+// Ring of the events of one thread, only this thread writes to it.
+struct ThreadBuffer {
+    size_t tid{};
+    std::vector<TraceEvent> events{};
+    size_t recorded = 0;
+};
+
+struct Tracer {
+    std::atomic<bool> enabled{false};
+    // Increased by every StartTracing, so that the threads take new buffers.
+    std::atomic<uint64_t> session{0};
+    std::mutex mutex{};
+    std::vector<std::shared_ptr<ThreadBuffer>> buffers{};
+    size_t capacity = 0;
+    int64_t origin_ns = 0;
+};
+
+Tracer& GetTracer() {
+    static Tracer tracer;
+    return tracer;
+}
+
+ThreadBuffer& GetThreadBuffer() {
+    thread_local uint64_t session = 0;
+    thread_local std::shared_ptr<ThreadBuffer> buffer;
+
+    Tracer& tracer = GetTracer();
+    uint64_t current = tracer.session.load(std::memory_order_acquire);
+    if (session != current || !buffer) {
+        std::lock_guard lock(tracer.mutex);
+        buffer = std::make_shared<ThreadBuffer>();
+        buffer->tid = tracer.buffers.size() + 1;
+        buffer->events.resize(tracer.capacity);
+        tracer.buffers.push_back(buffer);
+        session = current;
+    }
+    return *buffer;
+}
+
+void WriteEvent(std::ostream& out, const TraceEvent& event, size_t tid, int64_t origin_ns,
+                bool& first) {
+    out << (first ? "\n" : ",\n");
+    first = false;
+    out << "{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << tid
+        << ",\"ts\":" << (event.begin_ns - origin_ns) / 1000.0
+        << ",\"dur\":" << (event.end_ns - event.begin_ns) / 1000.0 << "}";
+}
+}  // namespace
+
+namespace trace {
+bool IsEnabled() {
+    return GetTracer().enabled.load(std::memory_order_relaxed);
+}
+
+int64_t NowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+void Record(const char* name, int64_t begin_ns, int64_t end_ns) {
+    ThreadBuffer& buffer = GetThreadBuffer();
+    if (buffer.events.empty()) {
+        return;
+    }
+    buffer.events[buffer.recorded % buffer.events.size()] = {name, begin_ns, end_ns};
+    ++buffer.recorded;
+}
+}  // namespace trace
+
+void StartTracing(size_t events_per_thread) {
+    Tracer& tracer = GetTracer();
+    {
+        std::lock_guard lock(tracer.mutex);
+        tracer.buffers.clear();
+        tracer.capacity = events_per_thread;
+        tracer.origin_ns = trace::NowNs();
+    }
+    tracer.session.fetch_add(1, std::memory_order_release);
+    tracer.enabled.store(true, std::memory_order_release);
+}
+
+void StopTracing(std::ostream& out) {
+    Tracer& tracer = GetTracer();
+    tracer.enabled.store(false, std::memory_order_release);
+
+    std::lock_guard lock(tracer.mutex);
+    out << "{\"traceEvents\":[";
+    bool first = true;
+    for (const std::shared_ptr<ThreadBuffer>& buffer : tracer.buffers) {
+        out << (first ? "\n" : ",\n");
+        first = false;
+        out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->tid
+            << ",\"args\":{\"name\":\"decoder " << buffer->tid << "\"}}";
+
+        size_t size = buffer->events.size();
+        size_t begin = buffer->recorded > size ? buffer->recorded - size : 0;
+        for (size_t i = begin; i < buffer->recorded; ++i) {
+            WriteEvent(out, buffer->events[i % size], buffer->tid, tracer.origin_ns, first);
+        }
+    }
+    out << "\n],\"displayTimeUnit\":\"ms\"}\n";
+    tracer.buffers.clear();
+}
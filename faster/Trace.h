@@ -0,0 +1,38 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+namespace trace {
+bool IsEnabled();
+
+void Record(const char* name, int64_t begin_ns, int64_t end_ns);
+
+int64_t NowNs();
+}  // namespace trace
+
+// Records the span from its construction to its destruction if tracing is on.
+// |name| has to be a string literal.
+class TraceSpan {
+public:
+    explicit TraceSpan(const char* name)
+        : name_(trace::IsEnabled() ? name : nullptr), begin_ns_(name_ ? trace::NowNs() : 0) {
+    }
+
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+    ~TraceSpan() {
+        if (name_) {
+            trace::Record(name_, begin_ns_, trace::NowNs());
+        }
+    }
+
+private:
+    const char* name_;
+    int64_t begin_ns_;
+};
+
+#define TRACE_SPAN_CONCAT_(a, b) a##b
+#define TRACE_SPAN_CONCAT(a, b) TRACE_SPAN_CONCAT_(a, b)
+#define TRACE_SPAN(name) TraceSpan TRACE_SPAN_CONCAT(trace_span_, __LINE__)(name)
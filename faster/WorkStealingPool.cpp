@@ -0,0 +1,112 @@
+#include "WorkStealingPool.h"
+
+#include <algorithm>
+
+namespace {
+// Pool and index of the worker running on this thread, if any.
+thread_local const void* current_pool = nullptr;
+thread_local size_t current_worker = 0;
+}  // namespace
+
+WorkStealingPool::WorkStealingPool(size_t threads) {
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (size_t i = 0; i < threads; ++i) {
+        queues_.push_back(std::make_unique<Queue>());
+    }
+    for (size_t i = 0; i < threads; ++i) {
+        threads_.emplace_back([this, i] { WorkerLoop(i); });
+    }
+}
+
+void WorkStealingPool::Submit(std::function<void()> task) {
+    size_t queue = current_pool == this ? current_worker : next_queue_++ % queues_.size();
+    // Counted before the task becomes visible, otherwise a running worker may
+    // pop and finish it before it is counted.
+    ++pending_;
+    {
+        std::lock_guard lock(queues_[queue]->mutex);
+        queues_[queue]->tasks.push_back(std::move(task));
+        ++queued_;
+    }
+    // A worker going to park counts itself idle before it checks |queued_|, so
+    // either it sees the task or it is seen here. The lock makes sure it is
+    // already waiting when notified.
+    if (idle_ > 0) {
+        std::lock_guard lock(mutex_);
+        wake_.notify_one();
+    }
+}
+
+void WorkStealingPool::Wait() {
+    std::unique_lock lock(mutex_);
+    done_.wait(lock, [this] { return pending_ == 0; });
+}
+
+size_t WorkStealingPool::ThreadsCount() const {
+    return threads_.size();
+}
+
+bool WorkStealingPool::TryPop(size_t worker, std::function<void()>& task) {
+    {
+        Queue& own = *queues_[worker];
+        std::lock_guard lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            --queued_;
+            return true;
+        }
+    }
+    for (size_t i = 1; i < queues_.size(); ++i) {
+        Queue& other = *queues_[(worker + i) % queues_.size()];
+        std::lock_guard lock(other.mutex);
+        if (!other.tasks.empty()) {
+            task = std::move(other.tasks.front());
+            other.tasks.pop_front();
+            --queued_;
+            return true;
+        }
+    }
+    return false;
+}
+
+void WorkStealingPool::WorkerLoop(size_t worker) {
+    current_pool = this;
+    current_worker = worker;
+    while (true) {
+        std::function<void()> task;
+        if (!TryPop(worker, task)) {
+            // Another worker may have taken the task first, then the queues
+            // are looked through again.
+            std::unique_lock lock(mutex_);
+            ++idle_;
+            wake_.wait(lock, [this] { return queued_ > 0 || stop_; });
+            --idle_;
+            if (queued_ == 0) {
+                return;
+            }
+            continue;
+        }
+
+        task();
+
+        if (--pending_ == 0) {
+            std::lock_guard lock(mutex_);
+            done_.notify_all();
+        }
+    }
+}
+
+WorkStealingPool::~WorkStealingPool() {
+    Wait();
+    {
+        std::lock_guard lock(mutex_);
+        stop_ = true;
+    }
+    wake_.notify_all();
+    for (std::thread& thread : threads_) {
+        thread.join();
+    }
+}
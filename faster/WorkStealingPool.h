@@ -0,0 +1,63 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Thread pool where every worker has its own queue of tasks. A worker takes
+// the newest task of its own queue and, when it runs out of them, steals the
+// oldest one from the others. Tasks must not throw.
+class WorkStealingPool {
+public:
+    // Zero threads means one per hardware thread.
+    explicit WorkStealingPool(size_t threads = 0);
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    // Tasks submitted by a worker go to its own queue, the rest are spread
+    // over all the queues.
+    void Submit(std::function<void()> task);
+
+    // Blocks until all the tasks are done, including the ones submitted by
+    // the tasks themselves.
+    void Wait();
+
+    size_t ThreadsCount() const;
+
+    ~WorkStealingPool();
+
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    bool TryPop(size_t worker, std::function<void()>& task);
+
+    void WorkerLoop(size_t worker);
+
+    std::vector<std::unique_ptr<Queue>> queues_{};
+    std::vector<std::thread> threads_{};
+    std::atomic<size_t> next_queue_{0};
+
+    // Tasks in the queues, changed under the lock of the queue.
+    std::atomic<size_t> queued_{0};
+    // Tasks submitted and not finished yet.
+    std::atomic<size_t> pending_{0};
+    // Workers parked on |wake_|.
+    std::atomic<size_t> idle_{0};
+
+    // Taken only to park the idle workers and to wake them, and to wait for
+    // the tasks to finish.
+    std::mutex mutex_{};
+    std::condition_variable wake_{};
+    std::condition_variable done_{};
+    bool stop_ = false;
+};
@@ -0,0 +1,305 @@
+#include <benchmark/benchmark.h>
+
+#include <decoder.h>
+#include <decode_options.h>
+#include <jpeg_info.h>
+#include <fft.h>
+#include <jpeg_decoder.h>
+
+#include "BitReader.h"
+#include "JPEG_Reader.h"
+#include "Tables.h"
+
+#include <algorithm>
+#include <array>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace {
+// Bytes without 0xFF, so that the bit reader never meets a marker.
+std::string RandomBytes(size_t size) {
+    std::mt19937 generator(42);
+    std::uniform_int_distribution<int> distribution(0, 0xFE);
+    std::string data(size, '\0');
+    for (char& c : data) {
+        c = static_cast<char>(distribution(generator));
+    }
+    return data;
+}
+
+std::string ReadFile(const std::string& path) {
+    std::ifstream fin(path, std::ios::binary);
+    return {std::istreambuf_iterator<char>(fin), std::istreambuf_iterator<char>()};
+}
+
+// Reported as MB and MP per second of the input bytes and the output pixels.
+void SetRates(benchmark::State& state, double bytes, double pixels) {
+    state.counters["MB"] = benchmark::Counter(bytes * state.iterations() / 1e6,
+                                              benchmark::Counter::kIsRate);
+    if (pixels > 0) {
+        state.counters["MP"] = benchmark::Counter(pixels * state.iterations() / 1e6,
+                                                  benchmark::Counter::kIsRate);
+    }
+}
+
+// Standard luminance AC table from Annex K.
+const std::vector<uint8_t> kCodeLengths = {0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7d};
+
+std::vector<uint8_t> TableValues() {
+    std::vector<uint8_t> values(162);
+    for (size_t i = 0; i < values.size(); ++i) {
+        values[i] = i;
+    }
+    return values;
+}
+
+void BM_BitReaderBits(benchmark::State& state) {
+    const std::string data = RandomBytes(1 << 16);
+    for (auto _ : state) {
+        std::istringstream input(data);
+        BitReader reader(input);
+        size_t ones = 0;
+        for (size_t i = 0; i + 1 < data.size() * 8; ++i) {
+            ones += reader.GetNextBit();
+        }
+        benchmark::DoNotOptimize(ones);
+    }
+    SetRates(state, data.size(), 0);
+}
+BENCHMARK(BM_BitReaderBits);
+
+void BM_BitReaderBytes(benchmark::State& state) {
+    const std::string data = RandomBytes(1 << 16);
+    for (auto _ : state) {
+        std::istringstream input(data);
+        BitReader reader(input);
+        size_t sum = 0;
+        for (size_t i = 0; i + 1 < data.size(); ++i) {
+            sum += reader.GetNextByte();
+        }
+        benchmark::DoNotOptimize(sum);
+    }
+    SetRates(state, data.size(), 0);
+}
+BENCHMARK(BM_BitReaderBytes);
+
+void BM_HuffmanTableBuild(benchmark::State& state) {
+    std::array<uint8_t, 16> code_lengths;
+    std::copy(kCodeLengths.begin(), kCodeLengths.end(), code_lengths.begin());
+    const std::vector<uint8_t> values = TableValues();
+    for (auto _ : state) {
+        HuffmanTable table(code_lengths, values);
+        benchmark::DoNotOptimize(table);
+    }
+}
+BENCHMARK(BM_HuffmanTableBuild);
+
+void BM_HuffmanTableDecode(benchmark::State& state) {
+    std::array<uint8_t, 16> code_lengths;
+    std::copy(kCodeLengths.begin(), kCodeLengths.end(), code_lengths.begin());
+    HuffmanTable table(code_lengths, TableValues());
+    const std::string data = RandomBytes(1 << 14);
+    // Codes are no longer than 16 bits, so the input is enough for them.
+    const size_t codes = data.size() / 2;
+    size_t consumed = 0;
+    for (auto _ : state) {
+        std::istringstream input(data);
+        BitReader reader(input);
+        size_t sum = 0;
+        for (size_t i = 0; i < codes; ++i) {
+            uint8_t value = 0;
+            table.Decode(reader, value);
+            sum += value;
+        }
+        benchmark::DoNotOptimize(sum);
+        consumed = reader.Offset();
+    }
+    // The rate is of the bytes the codes took, not of the whole input.
+    SetRates(state, consumed, 0);
+}
+BENCHMARK(BM_HuffmanTableDecode);
+
+void BM_DctInverse(benchmark::State& state) {
+    std::vector<double> input(64);
+    std::vector<double> output(64);
+    DctCalculator calculator(8, &input, &output);
+    std::array<double, 64> block;
+    std::mt19937 generator(42);
+    std::uniform_int_distribution<int> distribution(-256, 256);
+    for (double& value : block) {
+        value = distribution(generator);
+    }
+    for (auto _ : state) {
+        // Inverse scales the input in place, so all of it is refilled.
+        std::copy(block.begin(), block.end(), input.begin());
+        calculator.Inverse();
+        benchmark::DoNotOptimize(output.data());
+    }
+    SetRates(state, 64 * sizeof(double), 64);
+}
+BENCHMARK(BM_DctInverse);
+
+void BM_GetRGB(benchmark::State& state) {
+    for (auto _ : state) {
+        int sum = 0;
+        for (int y = -128; y < 128; y += 4) {
+            for (int c = -128; c < 128; c += 4) {
+                sum += JpegReader::GetRGB(y, c, -c).g;
+            }
+        }
+        benchmark::DoNotOptimize(sum);
+    }
+    SetRates(state, 64 * 64 * sizeof(RGB), 64 * 64);
+}
+BENCHMARK(BM_GetRGB);
+
+void BM_ToRGB(benchmark::State& state, const std::string& path) {
+    std::istringstream input(ReadFile(path));
+    JpegReader reader(input);
+    reader.ReadHeaders();
+    reader.ReadSOSHeader();
+    size_t channels = reader.GetInfo().components.size();
+    MCU mcu;
+    reader.ReadMCU(channels, mcu);
+    reader.HandleMCU(mcu, channels);
+    size_t width = 0;
+    size_t height = 0;
+    for (const JpegComponentInfo& component : reader.GetInfo().components) {
+        width = std::max<size_t>(width, 8 * component.horizontal);
+        height = std::max<size_t>(height, 8 * component.vertical);
+    }
+    std::vector<RGB> rgb(width * height);
+    size_t pixels = rgb.size();
+    for (auto _ : state) {
+        reader.ToRGB(mcu, channels, rgb.data(), width, width);
+        benchmark::DoNotOptimize(rgb.data());
+    }
+    SetRates(state, pixels * sizeof(RGB), pixels);
+}
+
+void BM_Decode(benchmark::State& state, const std::string& path) {
+    const std::string data = ReadFile(path);
+    size_t pixels = 0;
+    for (auto _ : state) {
+        std::istringstream input(data);
+        Image image = Decode(input);
+        pixels = image.Width() * image.Height();
+        benchmark::DoNotOptimize(image);
+    }
+    SetRates(state, data.size(), pixels);
+}
+
+// Icons and thumbnails, where the fixed cost of a call dominates. Reported as
+// decodes per second.
+void BM_DecodeTiny(benchmark::State& state, const std::string& path) {
+    const std::string data = ReadFile(path);
+    for (auto _ : state) {
+        std::istringstream input(data);
+        Image image = Decode(input);
+        benchmark::DoNotOptimize(image);
+    }
+    state.counters["decodes"] = benchmark::Counter(state.iterations(), benchmark::Counter::kIsRate);
+}
+
+void BM_DecodeTinyReused(benchmark::State& state, const std::string& path) {
+    const std::string data = ReadFile(path);
+    JpegDecoder decoder;
+    for (auto _ : state) {
+        std::istringstream input(data);
+        Image image = decoder.Decode(input);
+        benchmark::DoNotOptimize(image);
+    }
+    state.counters["decodes"] = benchmark::Counter(state.iterations(), benchmark::Counter::kIsRate);
+}
+
+#ifdef JPEG_DECODER_STATS
+// Hardware counters of the stages per decoded image, which tell for example
+// whether the entropy decoding is bound by branch misses.
+void BM_DecodeStages(benchmark::State& state, const std::string& path) {
+    const std::string data = ReadFile(path);
+    DecodeStats stats;
+    DecodeOptions options;
+    options.stats = &stats;
+    options.perf_counters = true;
+    for (auto _ : state) {
+        std::istringstream input(data);
+        Image image = Decode(input, options);
+        benchmark::DoNotOptimize(image);
+    }
+    if (stats.entropy_perf.cycles == 0) {
+        state.SkipWithError("perf_event_open is not permitted");
+        return;
+    }
+
+    auto average = [&state](uint64_t value) {
+        return benchmark::Counter(value, benchmark::Counter::kAvgIterations);
+    };
+    std::pair<const char*, const PerfCounters*> stages[] = {{"entropy", &stats.entropy_perf},
+                                                            {"idct", &stats.idct_perf},
+                                                            {"color", &stats.color_perf},
+                                                            {"output", &stats.output_perf}};
+    for (const auto& [name, perf] : stages) {
+        std::string prefix(name);
+        state.counters[prefix + "_cycles"] = average(perf->cycles);
+        state.counters[prefix + "_ipc"] =
+            static_cast<double>(perf->instructions) / std::max<uint64_t>(perf->cycles, 1);
+        state.counters[prefix + "_branch_misses"] = average(perf->branch_misses);
+        state.counters[prefix + "_l1d_misses"] = average(perf->l1d_misses);
+        state.counters[prefix + "_llc_misses"] = average(perf->llc_misses);
+    }
+}
+#endif
+}  // namespace
+
+int main(int argc, char** argv) {
+    benchmark::Initialize(&argc, argv);
+
+    // The images are the ones from tests/, or from the directory given as the
+    // first argument left after the benchmark flags.
+    std::string directory = argc > 1 ? argv[1] : JPEG_TEST_DIR;
+    std::vector<std::string> paths;
+    for (const auto& entry : std::filesystem::directory_iterator(directory)) {
+        if (entry.path().extension() == ".jpg") {
+            paths.push_back(entry.path().string());
+        }
+    }
+    std::sort(paths.begin(), paths.end());
+
+    benchmark::RegisterBenchmark("BM_ToRGB/chroma_halfed", BM_ToRGB,
+                                 std::string(JPEG_TEST_DIR) + "chroma_halfed.jpg");
+    for (const std::string& path : paths) {
+        std::ifstream probe_in(path, std::ios::binary);
+        JpegInfo info;
+        try {
+            info = ProbeJpeg(probe_in);
+        } catch (const std::exception&) {
+            // Progressive images and the like are not supported.
+            continue;
+        }
+        std::string name = "BM_Decode/" + std::filesystem::path(path).filename().string();
+        benchmark::RegisterBenchmark(name.c_str(), BM_Decode, path)
+            ->Unit(benchmark::kMillisecond);
+        if (std::filesystem::file_size(path) < 1024) {
+            std::string file = std::filesystem::path(path).filename().string();
+            benchmark::RegisterBenchmark(("BM_DecodeTiny/" + file).c_str(), BM_DecodeTiny, path);
+            benchmark::RegisterBenchmark(("BM_DecodeTinyReused/" + file).c_str(),
+                                         BM_DecodeTinyReused, path);
+        }
+#ifdef JPEG_DECODER_STATS
+        std::string stages_name =
+            "BM_DecodeStages/" + std::filesystem::path(path).filename().string();
+        benchmark::RegisterBenchmark(stages_name.c_str(), BM_DecodeStages, path)
+            ->Unit(benchmark::kMillisecond);
+#endif
+    }
+
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
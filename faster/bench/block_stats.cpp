@@ -0,0 +1,66 @@
+// Prints the histograms of the entropy-coded blocks of the images: EOB
+// positions, zero runs, Huffman code lengths and bits per MCU, for every image
+// with --per-image and for all of them together.
+//
+// Usage: block_stats [--per-image] <files or dirs>...
+
+#include <coefficients.h>
+
+#include "BlockStats.h"
+#include "JPEG_Reader.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+int main(int argc, char** argv) {
+    bool per_image = false;
+    std::vector<std::string> paths;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--per-image") {
+            per_image = true;
+        } else if (std::filesystem::is_directory(arg)) {
+            for (const auto& entry : std::filesystem::directory_iterator(arg)) {
+                if (entry.path().extension() == ".jpg") {
+                    paths.push_back(entry.path().string());
+                }
+            }
+        } else {
+            paths.push_back(arg);
+        }
+    }
+    if (paths.empty()) {
+        std::cerr << "Usage: " << argv[0] << " [--per-image] <files or dirs>..." << std::endl;
+        return 1;
+    }
+    std::sort(paths.begin(), paths.end());
+
+    BlockStats corpus;
+    size_t images = 0;
+    for (const std::string& path : paths) {
+        BlockStats stats;
+        std::ifstream input(path, std::ios::binary);
+        JpegReader reader(input);
+        reader.SetBlockStats(&stats);
+        JpegCoefficients coefficients;
+        if (!reader.ReadHeaders() || !reader.ReadCoefficients(coefficients)) {
+            std::cerr << path << ": " << reader.GetError().message << std::endl;
+            continue;
+        }
+        if (per_image) {
+            std::cout << "# " << path << "\n";
+            stats.Print(std::cout);
+            std::cout << "\n";
+        }
+        corpus.Merge(stats);
+        ++images;
+    }
+
+    std::cout << "# total of " << images << " images\n";
+    corpus.Print(std::cout);
+    return 0;
+}
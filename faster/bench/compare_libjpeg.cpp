@@ -0,0 +1,349 @@
+// Decodes the same images with libjpeg and with Decode, prints the speed of
+// both, the peak memory and the difference of the pixels. Every decoder is
+// measured in its own child process, so the peak memory is its own.
+//
+// Usage: compare_libjpeg [--repeat N] [--json out.json] <files or dirs>...
+
+#include <decoder.h>
+
+#include "libjpeg_error.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <jpeglib.h>
+#include <malloc.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+struct Run {
+    bool ok = false;
+    std::string error{};
+    double seconds = 0;
+    // Peak resident memory taken by the decoding, in KB.
+    size_t peak_rss_kb = 0;
+};
+
+struct Comparison {
+    std::string file{};
+    size_t width = 0;
+    size_t height = 0;
+    Run libjpeg{};
+    Run ours{};
+    double mean_error = 0;
+};
+
+std::string ReadFile(const std::string& path) {
+    std::ifstream fin(path, std::ios::binary);
+    return {std::istreambuf_iterator<char>(fin), std::istreambuf_iterator<char>()};
+}
+
+// Linux resets the peak RSS when 5 is written to clear_refs.
+void ResetPeakRss() {
+    std::ofstream("/proc/self/clear_refs") << "5";
+}
+
+size_t StatusKb(const std::string& field) {
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.rfind(field, 0) == 0) {
+            return std::strtoull(line.c_str() + field.size(), nullptr, 10);
+        }
+    }
+    return 0;
+}
+
+Image DecodeLibjpeg(const std::string& data) {
+    jpeg_decompress_struct cinfo;
+    LibjpegError error;
+    error.Install(cinfo);
+    jpeg_create_decompress(&cinfo);
+    struct Destroy {
+        jpeg_decompress_struct& cinfo;
+        ~Destroy() {
+            jpeg_destroy_decompress(&cinfo);
+        }
+    } destroy{cinfo};
+
+    LibjpegCall(error, [&] {
+        jpeg_mem_src(&cinfo, reinterpret_cast<const unsigned char*>(data.data()), data.size());
+        jpeg_read_header(&cinfo, static_cast<boolean>(true));
+        cinfo.out_color_space = JCS_RGB;
+        jpeg_start_decompress(&cinfo);
+    });
+
+    Image image(cinfo.output_width, cinfo.output_height);
+    std::vector<unsigned char> row(cinfo.output_width * 3);
+    while (cinfo.output_scanline < cinfo.output_height) {
+        size_t y = cinfo.output_scanline;
+        JSAMPROW rows[] = {row.data()};
+        LibjpegCall(error, [&] { jpeg_read_scanlines(&cinfo, rows, 1); });
+        for (size_t x = 0; x < image.Width(); ++x) {
+            image.SetPixel(y, x, {row[3 * x], row[3 * x + 1], row[3 * x + 2]});
+        }
+    }
+    LibjpegCall(error, [&] { jpeg_finish_decompress(&cinfo); });
+    return image;
+}
+
+Image DecodeOurs(const std::string& data) {
+    std::istringstream input(data);
+    return Decode(input);
+}
+
+template <class F>
+Run MeasureHere(F decode, size_t repeat) {
+    Run run;
+    // The free memory inherited from the parent would be reused unnoticed.
+    malloc_trim(0);
+    ResetPeakRss();
+    size_t rss_kb = StatusKb("VmRSS:");
+    try {
+        auto begin = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < repeat; ++i) {
+            // Freed before the next iteration.
+            Image image = decode();
+        }
+        auto end = std::chrono::steady_clock::now();
+        run.seconds = std::chrono::duration<double>(end - begin).count() / repeat;
+        run.ok = true;
+    } catch (const std::exception& e) {
+        run.error = e.what();
+    }
+    size_t peak_kb = StatusKb("VmHWM:");
+    run.peak_rss_kb = peak_kb > rss_kb ? peak_kb - rss_kb : 0;
+    return run;
+}
+
+// Runs the decoding in a child process, where nothing but the input is
+// allocated besides it, and passes the run back through a pipe.
+template <class F>
+Run Measure(F decode, size_t repeat) {
+    Run run;
+    int fds[2];
+    if (pipe(fds) != 0) {
+        run.error = "pipe failed";
+        return run;
+    }
+    std::cout.flush();
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(fds[0]);
+        close(fds[1]);
+        run.error = "fork failed";
+        return run;
+    }
+    if (pid == 0) {
+        close(fds[0]);
+        Run child = MeasureHere(decode, repeat);
+        std::ostringstream out;
+        out << std::setprecision(17) << child.ok << ' ' << child.seconds << ' '
+            << child.peak_rss_kb << ' ' << child.error;
+        std::string text = out.str();
+        for (size_t written = 0; written < text.size();) {
+            ssize_t count = write(fds[1], text.data() + written, text.size() - written);
+            if (count <= 0) {
+                break;
+            }
+            written += count;
+        }
+        _exit(0);
+    }
+
+    close(fds[1]);
+    std::string text;
+    char buffer[4096];
+    ssize_t count;
+    while ((count = read(fds[0], buffer, sizeof(buffer))) > 0) {
+        text.append(buffer, count);
+    }
+    close(fds[0]);
+    int status = 0;
+    waitpid(pid, &status, 0);
+
+    std::istringstream in(text);
+    if (!(in >> run.ok >> run.seconds >> run.peak_rss_kb)) {
+        run.ok = false;
+        run.error = "decoder crashed";
+        return run;
+    }
+    in.get();
+    std::getline(in, run.error);
+    return run;
+}
+
+double MeanError(const Image& a, const Image& b) {
+    if (a.Width() != b.Width() || a.Height() != b.Height()) {
+        return NAN;
+    }
+    double sum = 0;
+    for (size_t y = 0; y < a.Height(); ++y) {
+        for (size_t x = 0; x < a.Width(); ++x) {
+            RGB p = a.GetPixel(y, x);
+            RGB q = b.GetPixel(y, x);
+            sum += std::abs(p.r - q.r) + std::abs(p.g - q.g) + std::abs(p.b - q.b);
+        }
+    }
+    return sum / (3.0 * a.Width() * a.Height());
+}
+
+Comparison Compare(const std::string& path, size_t repeat) {
+    Comparison comparison;
+    comparison.file = path;
+    const std::string data = ReadFile(path);
+
+    comparison.libjpeg = Measure([&data] { return DecodeLibjpeg(data); }, repeat);
+    comparison.ours = Measure([&data] { return DecodeOurs(data); }, repeat);
+    if (comparison.libjpeg.ok) {
+        Image reference = DecodeLibjpeg(data);
+        comparison.width = reference.Width();
+        comparison.height = reference.Height();
+        if (comparison.ours.ok) {
+            comparison.mean_error = MeanError(reference, DecodeOurs(data));
+        }
+    }
+    return comparison;
+}
+
+double Megapixels(const Comparison& comparison) {
+    return comparison.width * comparison.height / 1e6;
+}
+
+std::string Rate(const Comparison& comparison, const Run& run) {
+    if (!run.ok) {
+        return "error";
+    }
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(2) << Megapixels(comparison) / run.seconds;
+    return out.str();
+}
+
+std::string JsonString(const std::string& value) {
+    std::string result = "\"";
+    for (char c : value) {
+        if (c == '"' || c == '\\') {
+            result += '\\';
+        }
+        result += c;
+    }
+    return result + '"';
+}
+
+void WriteRun(std::ostream& out, const Comparison& comparison, const Run& run) {
+    out << "{\"ok\": " << (run.ok ? "true" : "false");
+    if (run.ok) {
+        out << ", \"seconds\": " << run.seconds
+            << ", \"megapixels_per_second\": " << Megapixels(comparison) / run.seconds;
+    } else {
+        out << ", \"error\": " << JsonString(run.error);
+    }
+    out << ", \"peak_rss_kb\": " << run.peak_rss_kb << "}";
+}
+
+void WriteJson(std::ostream& out, const std::vector<Comparison>& comparisons, double libjpeg_rate,
+               double our_rate) {
+    out << "{\n  \"files\": [\n";
+    for (size_t i = 0; i < comparisons.size(); ++i) {
+        const Comparison& comparison = comparisons[i];
+        out << "    {\"file\": " << JsonString(comparison.file)
+            << ", \"width\": " << comparison.width << ", \"height\": " << comparison.height
+            << ", \"libjpeg\": ";
+        WriteRun(out, comparison, comparison.libjpeg);
+        out << ", \"decoder\": ";
+        WriteRun(out, comparison, comparison.ours);
+        out << ", \"mean_error\": ";
+        if (comparison.libjpeg.ok && comparison.ours.ok && !std::isnan(comparison.mean_error)) {
+            out << comparison.mean_error;
+        } else {
+            out << "null";
+        }
+        out << "}" << (i + 1 < comparisons.size() ? "," : "") << "\n";
+    }
+    out << "  ],\n  \"aggregate\": {\"libjpeg_megapixels_per_second\": " << libjpeg_rate
+        << ", \"decoder_megapixels_per_second\": " << our_rate << "}\n}\n";
+}
+}  // namespace
+
+int main(int argc, char** argv) {
+    size_t repeat = 3;
+    std::string json_path;
+    std::vector<std::string> paths;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--repeat" && i + 1 < argc) {
+            repeat = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--json" && i + 1 < argc) {
+            json_path = argv[++i];
+        } else if (std::filesystem::is_directory(arg)) {
+            for (const auto& entry : std::filesystem::directory_iterator(arg)) {
+                if (entry.path().extension() == ".jpg") {
+                    paths.push_back(entry.path().string());
+                }
+            }
+        } else {
+            paths.push_back(arg);
+        }
+    }
+    if (paths.empty()) {
+        std::cerr << "Usage: " << argv[0] << " [--repeat N] [--json out.json] <files or dirs>..."
+                  << std::endl;
+        return 1;
+    }
+    std::sort(paths.begin(), paths.end());
+
+    std::cout << std::left << std::setw(40) << "file" << std::right << std::setw(12) << "MP"
+              << std::setw(14) << "libjpeg MP/s" << std::setw(14) << "decoder MP/s"
+              << std::setw(14) << "libjpeg RSS" << std::setw(14) << "decoder RSS"
+              << std::setw(12) << "mean error" << "\n";
+
+    std::vector<Comparison> comparisons;
+    // Aggregates are over the files both decoders managed.
+    double megapixels = 0;
+    double libjpeg_seconds = 0;
+    double our_seconds = 0;
+    for (const std::string& path : paths) {
+        Comparison comparison = Compare(path, repeat);
+        std::cout << std::left << std::setw(40) << std::filesystem::path(path).filename().string()
+                  << std::right << std::fixed << std::setprecision(2) << std::setw(12)
+                  << Megapixels(comparison) << std::setw(14) << Rate(comparison, comparison.libjpeg)
+                  << std::setw(14) << Rate(comparison, comparison.ours) << std::setw(11)
+                  << comparison.libjpeg.peak_rss_kb / 1024 << " MB" << std::setw(11)
+                  << comparison.ours.peak_rss_kb / 1024 << " MB" << std::setw(12);
+        if (comparison.libjpeg.ok && comparison.ours.ok) {
+            std::cout << comparison.mean_error << "\n";
+        } else {
+            std::cout << "-" << "\n";
+        }
+        if (comparison.libjpeg.ok && comparison.ours.ok) {
+            megapixels += Megapixels(comparison);
+            libjpeg_seconds += comparison.libjpeg.seconds;
+            our_seconds += comparison.ours.seconds;
+        }
+        comparisons.push_back(std::move(comparison));
+    }
+
+    double libjpeg_rate = libjpeg_seconds > 0 ? megapixels / libjpeg_seconds : 0;
+    double our_rate = our_seconds > 0 ? megapixels / our_seconds : 0;
+    std::cout << std::left << std::setw(40) << "total" << std::right << std::setw(12) << megapixels
+              << std::setw(14) << libjpeg_rate << std::setw(14) << our_rate << "\n";
+
+    if (!json_path.empty()) {
+        std::ofstream json(json_path);
+        WriteJson(json, comparisons, libjpeg_rate, our_rate);
+    }
+    return 0;
+}
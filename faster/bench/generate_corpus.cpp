@@ -0,0 +1,179 @@
+// Writes deterministic synthetic JPEGs for the benchmarks, together with
+// manifest.csv describing them. The images with restart markers go to the
+// libjpeg_only subdirectory: the decoder doesn't handle DRI and RST, so they
+// only exercise libjpeg, for example in compare_libjpeg.
+//
+// Usage: generate_corpus <output dir> [max megapixels]
+
+#include "libjpeg_error.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+struct Size {
+    const char* name;
+    size_t width;
+    size_t height;
+};
+
+struct Sampling {
+    const char* name;
+    int components;
+    int h;
+    int v;
+};
+
+struct Variant {
+    Size size;
+    Sampling sampling;
+    int quality;
+    // In MCU rows, zero means no restart markers. The decoder doesn't support
+    // them, so these images are only for libjpeg.
+    int restart_rows;
+};
+
+const Size kSizes[] = {{"thumb", 160, 120},     {"vga", 640, 480},       {"hd", 1920, 1080},
+                       {"12mp", 4000, 3000},    {"100mp", 12240, 8160}};
+const Sampling kSamplings[] = {{"444", 3, 1, 1}, {"422", 3, 2, 1}, {"420", 3, 2, 2}, {"gray", 1, 1, 1}};
+const int kQualities[] = {50, 75, 90, 100};
+
+uint32_t Hash(uint32_t x, uint32_t y) {
+    uint32_t h = x * 0x9E3779B1u ^ y * 0x85EBCA77u;
+    h ^= h >> 15;
+    h *= 0x2C1B3C6Du;
+    h ^= h >> 12;
+    return h;
+}
+
+uint8_t Clamp(double value) {
+    return static_cast<uint8_t>(std::min(255.0, std::max(0.0, value)));
+}
+
+// Smooth gradients, periodic texture, hard edges and some noise, so that the
+// blocks cover the whole range from flat to busy.
+void FillRow(std::vector<uint8_t>& row, size_t y, size_t width, size_t height, int components) {
+    for (size_t x = 0; x < width; ++x) {
+        double u = static_cast<double>(x) / width;
+        double v = static_cast<double>(y) / height;
+        double texture = 40 * std::sin(x * 0.07) * std::cos(y * 0.05);
+        double edge = ((x / 64 + y / 64) % 2) * 30;
+        double noise = static_cast<int>(Hash(x, y) % 25) - 12;
+        double luma = 60 + 120 * u + texture + edge + noise;
+        if (components == 1) {
+            row[x] = Clamp(luma);
+            continue;
+        }
+        row[3 * x] = Clamp(luma + 60 * v);
+        row[3 * x + 1] = Clamp(luma);
+        row[3 * x + 2] = Clamp(luma + 80 * (0.5 - u) - edge);
+    }
+}
+
+size_t WriteJpeg(const std::string& path, const Variant& variant) {
+    FILE* file = fopen(path.c_str(), "wb");
+    if (!file) {
+        throw std::runtime_error("can't open " + path);
+    }
+    jpeg_compress_struct cinfo;
+    LibjpegError error;
+    error.Install(cinfo);
+    jpeg_create_compress(&cinfo);
+    struct Close {
+        jpeg_compress_struct& cinfo;
+        FILE* file;
+        ~Close() {
+            jpeg_destroy_compress(&cinfo);
+            fclose(file);
+        }
+    } close{cinfo, file};
+
+    const Sampling& sampling = variant.sampling;
+    LibjpegCall(error, [&] {
+        jpeg_stdio_dest(&cinfo, file);
+        cinfo.image_width = variant.size.width;
+        cinfo.image_height = variant.size.height;
+        cinfo.input_components = sampling.components;
+        cinfo.in_color_space = sampling.components == 1 ? JCS_GRAYSCALE : JCS_RGB;
+        jpeg_set_defaults(&cinfo);
+        jpeg_set_quality(&cinfo, variant.quality, static_cast<boolean>(true));
+        cinfo.comp_info[0].h_samp_factor = sampling.h;
+        cinfo.comp_info[0].v_samp_factor = sampling.v;
+        for (int i = 1; i < sampling.components; ++i) {
+            cinfo.comp_info[i].h_samp_factor = 1;
+            cinfo.comp_info[i].v_samp_factor = 1;
+        }
+        cinfo.restart_in_rows = variant.restart_rows;
+        cinfo.optimize_coding = static_cast<boolean>(false);
+        jpeg_start_compress(&cinfo, static_cast<boolean>(true));
+    });
+
+    std::vector<uint8_t> row(variant.size.width * sampling.components);
+    while (cinfo.next_scanline < cinfo.image_height) {
+        FillRow(row, cinfo.next_scanline, variant.size.width, variant.size.height,
+                sampling.components);
+        JSAMPROW rows[] = {row.data()};
+        LibjpegCall(error, [&] { jpeg_write_scanlines(&cinfo, rows, 1); });
+    }
+    LibjpegCall(error, [&] { jpeg_finish_compress(&cinfo); });
+    return ftell(file);
+}
+
+// Every size with every sampling at the usual quality, the quality and the
+// restart interval are varied only for the HD images.
+std::vector<Variant> ListVariants(double max_megapixels) {
+    std::vector<Variant> variants;
+    for (const Size& size : kSizes) {
+        if (size.width * size.height > max_megapixels * 1e6) {
+            continue;
+        }
+        for (const Sampling& sampling : kSamplings) {
+            variants.push_back({size, sampling, 75, 0});
+            if (std::string(size.name) != "hd") {
+                continue;
+            }
+            for (int quality : kQualities) {
+                if (quality != 75) {
+                    variants.push_back({size, sampling, quality, 0});
+                }
+            }
+            variants.push_back({size, sampling, 75, 1});
+        }
+    }
+    return variants;
+}
+}  // namespace
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " <output dir> [max megapixels]" << std::endl;
+        return 1;
+    }
+    std::filesystem::path directory = argv[1];
+    double max_megapixels = argc > 2 ? std::stod(argv[2]) : 100;
+    std::filesystem::create_directories(directory / "libjpeg_only");
+
+    std::ofstream manifest(directory / "manifest.csv");
+    manifest << "file,width,height,sampling,quality,restart_rows,bytes\n";
+    for (const Variant& variant : ListVariants(max_megapixels)) {
+        std::string name = (variant.restart_rows ? "libjpeg_only/" : "") +
+                           std::string(variant.size.name) + "_" + variant.sampling.name + "_q" +
+                           std::to_string(variant.quality) +
+                           (variant.restart_rows ? "_rst" : "") + ".jpg";
+        size_t bytes = WriteJpeg((directory / name).string(), variant);
+        manifest << name << ',' << variant.size.width << ',' << variant.size.height << ','
+                 << variant.sampling.name << ',' << variant.quality << ','
+                 << variant.restart_rows << ',' << bytes << '\n';
+        std::cout << name << ' ' << bytes << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <csetjmp>
+#include <cstdio>
+#include <stdexcept>
+
+#include <jpeglib.h>
+
+// The default error_exit of libjpeg calls exit(), this one jumps back to
+// LibjpegCall, which throws.
+struct LibjpegError {
+    jpeg_error_mgr manager;
+    std::jmp_buf jump;
+    char message[JMSG_LENGTH_MAX];
+
+    // Installs the manager into |cinfo|, before it is created.
+    template <class Struct>
+    void Install(Struct& cinfo) {
+        cinfo.err = jpeg_std_error(&manager);
+        manager.error_exit = Exit;
+    }
+
+    static void Exit(j_common_ptr cinfo) {
+        auto* error = reinterpret_cast<LibjpegError*>(cinfo->err);
+        (*cinfo->err->format_message)(cinfo, error->message);
+        std::longjmp(error->jump, 1);
+    }
+};
+
+// The jump skips only the frames of libjpeg and of |call|, which must not
+// own objects with destructors.
+template <class F>
+void LibjpegCall(LibjpegError& error, F call) {
+    if (setjmp(error.jump)) {
+        throw std::runtime_error(error.message);
+    }
+    call();
+}
@@ -1,54 +1,63 @@
 #pragma once
 
 #include <decoder.h>
+#include <decode_options.h>
+#include <decode_error.h>
+#include <jpeg_info.h>
+#include <jpeg_tables.h>
+#include <coefficients.h>
+#include "DecodeWithReader.h"
 #include "JPEG_Reader.h"
-#include <glog/logging.h>
+#include "Trace.h"
+
+namespace {
+// Buffers bigger than this are not kept by the reader of the thread.
+constexpr size_t kMaxKeptBufferBytes = 1 << 20;
+}  // namespace
 
 Image Decode(std::istream& input) {
-    Image image;
+    return Decode(input, {});
+}
+
+Image Decode(std::istream& input, const DecodeOptions& options, DecodeStatus* status) {
+    Result<Image, DecodeError> result = TryDecode(input, options, status);
+    if (!result) {
+        ThrowDecodeError(result.Error());
+    }
+    return std::move(result.Value());
+}
+
+Result<Image, DecodeError> TryDecode(std::istream& input, const DecodeOptions& options,
+                                     DecodeStatus* status) {
+    TRACE_SPAN("decode");
+    JpegReader& reader = GetThreadReader(input);
+    Result<Image, DecodeError> result = DecodeWithReader(reader, options, status);
+    reader.TrimBuffers(kMaxKeptBufferBytes);
+    return result;
+}
+
+JpegInfo ProbeJpeg(std::istream& input) {
     JpegReader reader(input);
+    if (!reader.ReadHeaders()) {
+        ThrowDecodeError(reader.GetError());
+    }
+    return reader.GetInfo();
+}
 
-    if (reader.GetMarker() != SOI) {
-        throw std::invalid_argument("Image has to start with SOI marker");
+std::shared_ptr<const JpegTables> LoadTables(std::istream& input) {
+    JpegReader reader(input);
+    std::shared_ptr<const JpegTables> tables = reader.ReadTables();
+    if (!tables) {
+        ThrowDecodeError(reader.GetError());
     }
+    return tables;
+}
 
-    DLOG(INFO) << "Found SOI";
-
-    while (true) {
-        switch (reader.GetMarker()) {
-            case SOI:
-                DLOG(ERROR) << "SOI in the middle";
-                throw std::runtime_error("Invalid Marker");
-            case EOI:
-                DLOG(ERROR) << "EOI in the middle";
-                throw std::runtime_error("Invalid Marker");
-            case COM:
-                DLOG(INFO) << "Reading commentary";
-                reader.ReadComment(image);
-                break;
-            case APP:
-                DLOG(INFO) << "Reading APP";
-                reader.ReadApp();
-                break;
-            case DQT:
-                DLOG(INFO) << "Reading DQT";
-                reader.ReadDQT();
-                break;
-            case SOF0:
-                DLOG(INFO) << "Reading SOF0";
-                reader.ReadSOF0(image);
-                break;
-            case DHT:
-                DLOG(INFO) << "Reading HT";
-                reader.ReadHT();
-                break;
-            case SOS:
-                DLOG(INFO) << "Reading SOS";
-                reader.ReadSOS(image);
-                return image;
-            default:
-                DLOG(ERROR) << "Unknown marker";
-                throw std::runtime_error("Invalid marker");
-        }
+JpegCoefficients DecodeCoefficients(std::istream& input) {
+    JpegReader reader(input);
+    JpegCoefficients coefficients;
+    if (!reader.ReadHeaders() || !reader.ReadCoefficients(coefficients)) {
+        ThrowDecodeError(reader.GetError());
     }
+    return coefficients;
 }
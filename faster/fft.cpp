@@ -2,6 +2,29 @@
 
 #include <fftw3.h>
 #include <cmath>
+#include <map>
+#include <mutex>
+
+namespace {
+// FFTW planner is not thread-safe, so the plans are made once per width under
+// the lock and never destroyed. Executing a plan on new arrays is thread-safe.
+fftw_plan GetPlan(size_t width) {
+    static std::mutex mutex;
+    static std::map<size_t, fftw_plan> plans;
+
+    std::lock_guard lock(mutex);
+    fftw_plan& plan = plans[width];
+    if (!plan) {
+        double* input = fftw_alloc_real(width * width);
+        double* output = fftw_alloc_real(width * width);
+        plan = fftw_plan_r2r_2d(width, width, input, output, FFTW_REDFT01, FFTW_REDFT01,
+                                FFTW_ESTIMATE | FFTW_UNALIGNED);
+        fftw_free(input);
+        fftw_free(output);
+    }
+    return plan;
+}
+}  // namespace
 
 class DctCalculator::Impl {
 public:
@@ -10,19 +33,13 @@ public:
         if (input->size() != width * width || output->size() != width * width) {
             throw std::invalid_argument("Invalid data");
         }
-        plan = fftw_plan_r2r_2d(width, width, &(input->at(0)), &(output->at(0)), FFTW_REDFT01,
-                                FFTW_REDFT01, FFTW_ESTIMATE);
+        plan = GetPlan(width);
     }
 
     size_t width{};
     std::vector<double> *input{};
     std::vector<double> *output{};
     fftw_plan plan{};
-
-    ~Impl() {
-        fftw_destroy_plan(plan);
-        fftw_cleanup();
-    }
 };
 
 DctCalculator::DctCalculator(size_t width, std::vector<double> *input, std::vector<double> *output)
@@ -38,7 +55,7 @@ void DctCalculator::Inverse() {
         impl_->input->at(i) *= sqrt(2);
     }
 
-    fftw_execute(impl_->plan);
+    fftw_execute_r2r(impl_->plan, impl_->input->data(), impl_->output->data());
 
     for (size_t i = 0; i < impl_->width * impl_->width; ++i) {
         impl_->output->at(i) /= 16;
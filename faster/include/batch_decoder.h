@@ -0,0 +1,46 @@
+#pragma once
+
+#include <decode_options.h>
+
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <istream>
+#include <vector>
+
+struct BatchOptions {
+    // Number of worker threads, zero means one per hardware thread.
+    size_t threads = 0;
+    // Images with more pixels are reconstructed by several workers: the
+    // entropy-coded segment is decoded by one of them and the bands of MCU
+    // rows are dequantized, transformed and converted by any idle worker.
+    size_t split_pixels = 1 << 20;
+    // Bytes that the images being decoded at once may take, zero means no
+    // limit. The peak memory of every image is estimated from its headers and
+    // the image is started only when it fits, the inputs are admitted in
+    // order. If there is room for the image but not for reconstructing it by
+    // several workers, it is decoded sequentially, which needs less memory.
+    // An image that doesn't fit even when alone is decoded alone. The inputs
+    // have to be seekable to read the headers twice.
+    size_t memory_budget = 0;
+};
+
+struct BatchResult {
+    // Position of the input in the batch.
+    size_t index = 0;
+    Image image{};
+    DecodeStatus status{};
+    // Set if the decoding failed, the image is empty then.
+    std::exception_ptr error{};
+};
+
+// Called from the worker threads, but never for two results at once. The
+// results come in the order the images are finished.
+using BatchCallback = std::function<void(BatchResult result)>;
+
+// Decodes all the inputs on a pool of threads and returns when every result
+// is passed to the callback. The inputs have to stay valid until then. If the
+// callback throws, the other results are still passed to it and the first
+// exception is rethrown once the batch is done.
+void DecodeBatch(const std::vector<std::istream*>& inputs, const DecodeOptions& options,
+                 const BatchCallback& callback, const BatchOptions& batch_options = {});
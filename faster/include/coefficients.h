@@ -0,0 +1,78 @@
+#pragma once
+
+#include <image.h>
+#include <decode_options.h>
+#include <jpeg_info.h>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <memory>
+#include <vector>
+
+struct ComponentCoefficients {
+    JpegComponentInfo info{};
+    // Size of the plane in blocks, including the padding up to whole MCUs.
+    size_t width_in_blocks{};
+    size_t height_in_blocks{};
+    // Quantized coefficients, 64 per block in the natural (row by row) order,
+    // blocks go row by row.
+    std::vector<int16_t> coefficients{};
+    // Quantization table in the natural order.
+    std::array<uint16_t, 64> quant_table{};
+
+    int16_t* Block(size_t block_y, size_t block_x) {
+        return coefficients.data() + (block_y * width_in_blocks + block_x) * 64;
+    }
+
+    const int16_t* Block(size_t block_y, size_t block_x) const {
+        return coefficients.data() + (block_y * width_in_blocks + block_x) * 64;
+    }
+};
+
+struct JpegCoefficients {
+    JpegInfo info{};
+    std::vector<ComponentCoefficients> components{};
+};
+
+// Stops after entropy decoding: neither dequantization, nor IDCT, nor color
+// conversion are done.
+JpegCoefficients DecodeCoefficients(std::istream& input);
+
+enum class PixelFormat {
+    kRgb,
+    // Only the luma is reconstructed, r, g and b are equal.
+    kGrayscale
+};
+
+// Entropy-decoded image that can be rendered many times at different sizes.
+class DecodedCoefficients {
+public:
+    explicit DecodedCoefficients(std::istream& input);
+
+    explicit DecodedCoefficients(JpegCoefficients coefficients);
+
+    DecodedCoefficients(const DecodedCoefficients&) = delete;
+    DecodedCoefficients& operator=(const DecodedCoefficients&) = delete;
+
+    DecodedCoefficients(DecodedCoefficients&&);
+    DecodedCoefficients& operator=(DecodedCoefficients&&);
+
+    const JpegInfo& GetInfo() const;
+
+    const JpegCoefficients& GetCoefficients() const;
+
+    // Renders the image downscaled by |scale_denom|, which is 1, 2, 4 or 8:
+    // the blocks are transformed by the IDCT of size 8 / scale_denom. |roi| is
+    // given in the coordinates of the downscaled image. Can be called from
+    // several threads at once.
+    Image Render(size_t scale_denom = 1, PixelFormat format = PixelFormat::kRgb,
+                 DecodeRegion roi = {}) const;
+
+    ~DecodedCoefficients();
+
+private:
+    class Impl;
+    std::unique_ptr<Impl> impl_;
+};
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <decode_options.h>
+#include <jpeg_info.h>
+
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+
+// Monotonic memory resource for decoding one image, sized from its headers so
+// that the image and the buffers of the decoding take one upstream
+// allocation. Nothing is freed before the arena is destroyed, then everything
+// is freed at once, so it has to outlive the decoded image. The Huffman
+// tables are shared between the decodings and don't come from the arena.
+//
+//     JpegInfo info = ProbeJpeg(input);
+//     input.seekg(0);
+//     DecodeArena arena(info);
+//     DecodeOptions options;
+//     options.memory_resource = arena.Resource();
+//     Image image = Decode(input, options);
+class DecodeArena {
+public:
+    // The image is expected to be decoded with these options, only the
+    // region of interest matters.
+    explicit DecodeArena(const JpegInfo& info, const DecodeOptions& options = {});
+
+    DecodeArena(const DecodeArena&) = delete;
+    DecodeArena& operator=(const DecodeArena&) = delete;
+
+    DecodeArena(DecodeArena&&);
+    DecodeArena& operator=(DecodeArena&&);
+
+    std::pmr::memory_resource* Resource();
+
+    // Bytes taken from the upstream resource at the first allocation.
+    size_t InitialSize() const;
+
+    ~DecodeArena();
+
+private:
+    class Impl;
+    std::unique_ptr<Impl> impl_;
+};
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <image.h>
+#include <result.h>
+#include <decode_options.h>
+
+#include <cstddef>
+#include <istream>
+#include <string>
+
+enum class DecodeErrorCode {
+    // The input does not start with SOI.
+    kNotJpeg,
+    kInvalidMarker,
+    // The input ends before the image does.
+    kTruncated,
+    kInvalidHeader,
+    // The image is valid but not baseline, like progressive.
+    kUnsupported,
+    // Error in the entropy-coded segment.
+    kInvalidScan,
+    kLimitExceeded
+};
+
+struct DecodeError {
+    DecodeErrorCode code{};
+    // Offset of the error from the position where the input started.
+    size_t offset = 0;
+    std::string message{};
+};
+
+// Same as Decode, but returns the error instead of throwing. The errors of the
+// input are passed up from the decoding loops without exceptions, so the junk
+// is rejected at little cost. Decode throws the same errors.
+Result<Image, DecodeError> TryDecode(std::istream& input, const DecodeOptions& options = {},
+                                     DecodeStatus* status = nullptr);
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <cstddef>
+
+// Limits against hostile inputs, checked before the image is allocated. Zero
+// means no limit.
+struct DecodeLimits {
+    size_t max_dimension = 0;
+    size_t max_pixels = 0;
+    // Pixels of the image per byte of the input left after the SOS marker.
+    // Only checked for seekable inputs.
+    size_t max_pixels_per_input_byte = 0;
+    // Bytes taken by the decoded image and the working buffers.
+    size_t max_memory = 0;
+};
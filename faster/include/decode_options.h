@@ -0,0 +1,56 @@
+#pragma once
+
+#include <image.h>
+#include <decode_limits.h>
+#include <decode_stats.h>
+#include <jpeg_tables.h>
+
+#include <cstddef>
+#include <istream>
+#include <memory>
+#include <memory_resource>
+#include <string>
+
+struct DecodeRegion {
+    size_t x = 0;
+    size_t y = 0;
+    size_t width = 0;
+    size_t height = 0;
+};
+
+struct DecodeOptions {
+    // Errors in the entropy-coded segment don't fail the decoding: the rows
+    // decoded before the error are returned and the rest are filled gray.
+    bool allow_partial = false;
+    // Only this part of the image is reconstructed and returned, the scan is
+    // not read past its last MCU row. An empty region means the whole image.
+    DecodeRegion roi{};
+    // Tables for abbreviated images which don't define all the tables they
+    // use. The ones defined by the image take precedence.
+    std::shared_ptr<const JpegTables> tables{};
+    // Images exceeding the limits are rejected with std::invalid_argument.
+    DecodeLimits limits{};
+    // Filled with the statistics of the decoding if not null. Ignored by
+    // DecodeBatch, whose images are decoded on several threads.
+    DecodeStats* stats = nullptr;
+    // Also counts the hardware events of the stages into the stats with
+    // perf_event_open. This costs a system call per stage of every MCU row,
+    // the counters stay zero if perf events are not permitted or not on Linux.
+    bool perf_counters = false;
+    // The image and the buffers of the decoding are allocated from it if it
+    // is not null, see DecodeArena. It has to outlive the returned image.
+    // Ignored by DecodeBatch, whose threads would share it.
+    std::pmr::memory_resource* memory_resource = nullptr;
+};
+
+struct DecodeStatus {
+    bool complete = true;
+    // Rows starting from the top that hold decoded data.
+    size_t rows_decoded = 0;
+    // What stopped the decoding if it is not complete.
+    std::string error{};
+};
+
+// Same as Decode(input), |status| tells how much of the image is decoded
+// when partial images are allowed.
+Image Decode(std::istream& input, const DecodeOptions& options, DecodeStatus* status = nullptr);
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <perf_counters.h>
+
+#include <cstddef>
+#include <cstdint>
+
+// Where the time of the decoding goes. Filled only if the library is built
+// with JPEG_DECODER_STATS, the counters are added to.
+struct DecodeStats {
+    uint64_t header_ns = 0;
+    // Huffman decoding of the blocks.
+    uint64_t entropy_ns = 0;
+    // Dequantization and IDCT.
+    uint64_t idct_ns = 0;
+    // Color conversion into the band of MCU rows.
+    uint64_t color_ns = 0;
+    // Copying the pixels from the band to the image.
+    uint64_t output_ns = 0;
+    size_t mcus = 0;
+    size_t blocks = 0;
+    // Input bytes read from the start of the image, zero if the input is not
+    // seekable.
+    size_t bytes_consumed = 0;
+    size_t markers = 0;
+    // APP sections which are skipped without looking inside.
+    size_t segments_skipped = 0;
+    // Allocations from the memory resource of the decoding, counted through a
+    // wrapper of it: the image and the buffers of the scan. A reused
+    // JpegDecoder allocates only for the image once it is warmed up.
+    size_t allocations = 0;
+    // Bytes of the image and the working buffers held at once.
+    size_t peak_bytes = 0;
+    // Filled only if DecodeOptions::perf_counters is set.
+    PerfCounters header_perf{};
+    PerfCounters entropy_perf{};
+    PerfCounters idct_perf{};
+    PerfCounters color_perf{};
+    PerfCounters output_perf{};
+};
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <decode_options.h>
+
+#include <istream>
+#include <memory>
+
+// Decodes images one after another keeping the IDCT plan, the working buffers
+// and the table storage between the calls. Not thread-safe, use one decoder
+// per thread.
+class JpegDecoder {
+public:
+    JpegDecoder();
+
+    JpegDecoder(const JpegDecoder&) = delete;
+    JpegDecoder& operator=(const JpegDecoder&) = delete;
+
+    JpegDecoder(JpegDecoder&&);
+    JpegDecoder& operator=(JpegDecoder&&);
+
+    Image Decode(std::istream& input, const DecodeOptions& options = {},
+                 DecodeStatus* status = nullptr);
+
+    ~JpegDecoder();
+
+private:
+    class Impl;
+    std::unique_ptr<Impl> impl_;
+};
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <string>
+#include <vector>
+
+struct JpegComponentInfo {
+    uint8_t id{};
+    uint8_t horizontal{};
+    uint8_t vertical{};
+    uint8_t quant_table{};
+};
+
+// Everything that is known about the image before the first SOS section.
+struct JpegInfo {
+    size_t width{};
+    size_t height{};
+    std::vector<JpegComponentInfo> components{};
+    // Ids of the tables defined by DQT and DHT sections.
+    std::vector<uint8_t> quant_tables{};
+    std::vector<uint8_t> dc_tables{};
+    std::vector<uint8_t> ac_tables{};
+    std::string comment{};
+};
+
+// Reads the headers up to the SOS marker. Neither the entropy-coded segment
+// nor the pixel buffer is touched.
+JpegInfo ProbeJpeg(std::istream& input);
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <istream>
+#include <memory>
+
+// Immutable set of DQT and DHT tables, can be shared between threads.
+struct JpegTables;
+
+// Reads a tables-only stream (SOI, DQT and DHT sections, EOI), which is sent
+// once before the abbreviated images using these tables.
+std::shared_ptr<const JpegTables> LoadTables(std::istream& input);
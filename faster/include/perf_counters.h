@@ -0,0 +1,13 @@
+#pragma once
+
+#include <cstdint>
+
+// Hardware events of the thread during one stage of the decoding.
+struct PerfCounters {
+    uint64_t cycles = 0;
+    uint64_t instructions = 0;
+    uint64_t branch_misses = 0;
+    // Read misses of the L1 data cache and of the last level cache.
+    uint64_t l1d_misses = 0;
+    uint64_t llc_misses = 0;
+};
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <image.h>
+#include <jpeg_info.h>
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+struct PushProgress {
+    // GetInfo() can be called from now on.
+    bool header_ready = false;
+    // The whole image was decoded, later input is ignored.
+    bool done = false;
+    // Number of input bytes that were decoded so far.
+    size_t bytes_consumed = 0;
+    // Rows completed by the last Feed, rows_count * width pixels starting at
+    // the image row first_row.
+    size_t first_row = 0;
+    size_t rows_count = 0;
+    std::vector<RGB> rows{};
+};
+
+// Decodes the image from the data pushed in chunks of any size. When a chunk
+// ends in the middle of an MCU, the decoding stops after the last complete
+// MCU and goes on from there when more data is fed, so every MCU is decoded
+// once. A section cut by the chunk is read again from its start. Invalid data
+// is reported with exceptions, as in Decode.
+class PushDecoder {
+public:
+    PushDecoder();
+
+    PushDecoder(const PushDecoder&) = delete;
+    PushDecoder& operator=(const PushDecoder&) = delete;
+
+    PushDecoder(PushDecoder&&);
+    PushDecoder& operator=(PushDecoder&&);
+
+    PushProgress Feed(const char* data, size_t size);
+
+    const JpegInfo& GetInfo() const;
+
+    bool Done() const;
+
+    ~PushDecoder();
+
+private:
+    class Impl;
+    std::unique_ptr<Impl> impl_;
+};
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <utility>
+#include <variant>
+
+// Either the value or the error, for the calls which report failures without
+// exceptions.
+template <class T, class E>
+class Result {
+public:
+    Result(T value) : data_(std::in_place_index<0>, std::move(value)) {
+    }
+
+    Result(E error) : data_(std::in_place_index<1>, std::move(error)) {
+    }
+
+    bool IsOk() const {
+        return data_.index() == 0;
+    }
+
+    explicit operator bool() const {
+        return IsOk();
+    }
+
+    T& Value() {
+        return std::get<0>(data_);
+    }
+
+    const T& Value() const {
+        return std::get<0>(data_);
+    }
+
+    const E& Error() const {
+        return std::get<1>(data_);
+    }
+
+private:
+    std::variant<T, E> data_;
+};
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <image.h>
+#include <jpeg_info.h>
+
+#include <cstddef>
+#include <istream>
+#include <memory>
+
+// Decodes the image top to bottom keeping only one row of MCUs in memory,
+// in the spirit of libjpeg's jpeg_read_scanlines.
+class ScanlineDecoder {
+public:
+    explicit ScanlineDecoder(std::istream& input);
+
+    ScanlineDecoder(const ScanlineDecoder&) = delete;
+    ScanlineDecoder& operator=(const ScanlineDecoder&) = delete;
+
+    ScanlineDecoder(ScanlineDecoder&&);
+    ScanlineDecoder& operator=(ScanlineDecoder&&);
+
+    // Reads all the sections up to the entropy-coded segment. Has to be
+    // called once before ReadRows.
+    const JpegInfo& ReadHeader();
+
+    // Writes no more than |max_rows| rows into |dst|, which must have room for
+    // max_rows * width pixels, rows follow one another. Returns the number of
+    // written rows, zero means that the whole image was read.
+    size_t ReadRows(RGB* dst, size_t max_rows);
+
+    // Number of rows returned so far.
+    size_t OutputScanline() const;
+
+    ~ScanlineDecoder();
+
+private:
+    class Impl;
+    std::unique_ptr<Impl> impl_;
+};
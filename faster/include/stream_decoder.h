@@ -0,0 +1,33 @@
+#pragma once
+
+#include <decode_options.h>
+
+#include <istream>
+#include <memory>
+
+// Decodes a stream of images following one another, like Motion JPEG. While
+// the frame is reconstructed on the worker thread of the decoder, the
+// entropy-coded segment of the next one is decoded by the calling thread.
+class JpegStreamDecoder {
+public:
+    // The tables, the limits, the region and the stats of |options| apply to
+    // every frame, the stats are filled by the calling thread only. The frames
+    // are reconstructed from their coefficients, so allow_partial and
+    // memory_resource are ignored.
+    explicit JpegStreamDecoder(std::istream& input, const DecodeOptions& options = {});
+
+    JpegStreamDecoder(const JpegStreamDecoder&) = delete;
+    JpegStreamDecoder& operator=(const JpegStreamDecoder&) = delete;
+
+    JpegStreamDecoder(JpegStreamDecoder&&);
+    JpegStreamDecoder& operator=(JpegStreamDecoder&&);
+
+    // Returns false if there are no frames left.
+    bool Next(Image& frame);
+
+    ~JpegStreamDecoder();
+
+private:
+    class Impl;
+    std::unique_ptr<Impl> impl_;
+};
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <cstddef>
+#include <ostream>
+
+// Starts recording the spans of the decoding stages on all threads: headers,
+// entropy decoding, IDCT and color conversion of every MCU row, copying to
+// the image. Every thread keeps its last |events_per_thread| spans.
+void StartTracing(size_t events_per_thread = 1 << 16);
+
+// Stops recording and writes the spans in the Chrome trace event format,
+// which chrome://tracing and Perfetto load. Has to be called after the traced
+// decodes are finished.
+void StopTracing(std::ostream& out);
@@ -4,5 +4,19 @@ add_library(decoder_faster
         JPEG_Reader.cpp
         BitReader.cpp
         huffman.cpp
+        Tables.cpp
         fft.cpp
-        decoder.cpp)
+        decoder.cpp
+        ScanlineDecoder.cpp
+        PushDecoder.cpp
+        DecodedCoefficients.cpp
+        JpegDecoder.cpp
+        JpegStreamDecoder.cpp
+        WorkStealingPool.cpp
+        BatchDecoder.cpp
+        Trace.cpp
+        PerfEvents.cpp
+        BlockStats.cpp
+        DecodeArena.cpp
+        CountingResource.cpp
+        DecodeWithReader.cpp)
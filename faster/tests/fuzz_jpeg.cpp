@@ -0,0 +1,20 @@
+#include <decode_options.h>
+
+#include <sstream>
+#include <string>
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    std::string s(reinterpret_cast<const char *>(data), size);
+    std::stringstream ss(s);
+    DecodeOptions options;
+    options.limits.max_dimension = 1 << 13;
+    options.limits.max_pixels = 1 << 24;
+    options.limits.max_pixels_per_input_byte = 1 << 10;
+    options.limits.max_memory = 1 << 28;
+    try {
+        auto image = Decode(ss, options);
+        (void)image;
+    } catch (...) {
+    }
+    return 0;
+}
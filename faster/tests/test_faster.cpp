@@ -1,9 +1,95 @@
 #include <test_commons.hpp>
 
 #include <catch.hpp>
+#include <decoder.h>
+#include <decode_options.h>
+#include <decode_error.h>
+#include <jpeg_tables.h>
+#include <jpeg_info.h>
+#include <scanline_decoder.h>
+#include <push_decoder.h>
+#include <coefficients.h>
+#include <jpeg_decoder.h>
+#include <stream_decoder.h>
+#include <batch_decoder.h>
+#include <trace.h>
+#include <decode_arena.h>
+#include <fft.h>
 
+#include "BlockStats.h"
+#include "JPEG_Reader.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
 #include <iostream>
+#include <iterator>
+#include <map>
+#include <memory_resource>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+// Upstream resource of a DecodeArena, which counts the blocks the arena takes.
+class CountingUpstream : public std::pmr::memory_resource {
+public:
+    size_t Count() const {
+        return count_;
+    }
+
+private:
+    void* do_allocate(size_t bytes, size_t alignment) override {
+        ++count_;
+        return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+    }
+
+    void do_deallocate(void* pointer, size_t bytes, size_t alignment) override {
+        std::pmr::new_delete_resource()->deallocate(pointer, bytes, alignment);
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+
+    size_t count_ = 0;
+};
+}  // namespace
+
+namespace {
+bool Differ(const RGB& pixel, const RGB& expected) {
+    return pixel.r != expected.r || pixel.g != expected.g || pixel.b != expected.b;
+}
+
+// Pixels of |image| which differ from the part of |expected| at (y, x).
+size_t CountMismatches(const Image& image, const Image& expected, size_t y = 0, size_t x = 0) {
+    size_t mismatches = 0;
+    for (size_t i = 0; i < image.Height(); ++i) {
+        for (size_t j = 0; j < image.Width(); ++j) {
+            mismatches += Differ(image.GetPixel(i, j), expected.GetPixel(y + i, x + j));
+        }
+    }
+    return mismatches;
+}
+
+// Same for |count| rows of |width| pixels.
+size_t CountMismatches(const RGB* rows, size_t width, size_t count, const Image& expected,
+                       size_t y) {
+    size_t mismatches = 0;
+    for (size_t i = 0; i < count; ++i) {
+        for (size_t j = 0; j < width; ++j) {
+            mismatches += Differ(rows[i * width + j], expected.GetPixel(y + i, j));
+        }
+    }
+    return mismatches;
+}
+}  // namespace
 
 TEST_CASE("huge", "[jpg]") {
 #ifdef NDEBUG
@@ -17,3 +103,933 @@ TEST_CASE("huge", "[jpg]") {
         << std::endl;
 #endif
 }
+
+TEST_CASE("probe", "[probe]") {
+    std::ifstream fin(GetTestImagePath("small.jpg"));
+    JpegInfo info = ProbeJpeg(fin);
+    REQUIRE(info.width == 32);
+    REQUIRE(info.height == 32);
+    REQUIRE(info.comment == ":)");
+    REQUIRE(info.components.size() == 3);
+    REQUIRE(info.components[0].horizontal == 2);
+    REQUIRE(info.components[0].vertical == 2);
+    REQUIRE(info.components[1].horizontal == 1);
+    REQUIRE(info.components[1].vertical == 1);
+    REQUIRE(info.quant_tables.size() == 2);
+    REQUIRE(info.dc_tables.size() == 2);
+    REQUIRE(info.ac_tables.size() == 2);
+
+    std::ifstream gray(GetTestImagePath("grayscale.jpg"));
+    info = ProbeJpeg(gray);
+    REQUIRE(info.width == 600);
+    REQUIRE(info.height == 600);
+    REQUIRE(info.components.size() == 1);
+}
+
+TEST_CASE("probe errors", "[probe]") {
+    std::ifstream fin(GetTestImagePath("bad/bad1.jpg"));
+    REQUIRE_THROWS(ProbeJpeg(fin));
+}
+
+TEST_CASE("scanlines", "[scanline]") {
+    for (const char* filename : {"small.jpg", "chroma_halfed.jpg", "grayscale.jpg", "tiny.jpg"}) {
+        std::ifstream full_in(GetTestImagePath(filename));
+        Image expected = Decode(full_in);
+
+        std::ifstream fin(GetTestImagePath(filename));
+        ScanlineDecoder decoder(fin);
+        const JpegInfo& info = decoder.ReadHeader();
+        REQUIRE(info.width == expected.Width());
+        REQUIRE(info.height == expected.Height());
+
+        std::vector<RGB> rows(3 * info.width);
+        size_t y = 0;
+        size_t mismatches = 0;
+        while (size_t count = decoder.ReadRows(rows.data(), 3)) {
+            mismatches += CountMismatches(rows.data(), info.width, count, expected, y);
+            y += count;
+        }
+        REQUIRE(mismatches == 0);
+        REQUIRE(y == info.height);
+        REQUIRE(decoder.OutputScanline() == info.height);
+    }
+}
+
+TEST_CASE("push decoding", "[push]") {
+    for (auto [filename, chunk_size] : {std::pair<const char*, size_t>{"small.jpg", 1},
+                                        {"tiny.jpg", 3},
+                                        {"test.jpg", 997},
+                                        {"grayscale.jpg", 4096}}) {
+        std::ifstream full_in(GetTestImagePath(filename));
+        Image expected = Decode(full_in);
+
+        std::ifstream fin(GetTestImagePath(filename));
+        std::string data((std::istreambuf_iterator<char>(fin)), std::istreambuf_iterator<char>());
+
+        PushDecoder decoder;
+        size_t next_row = 0;
+        size_t mismatches = 0;
+        for (size_t pos = 0; pos < data.size(); pos += chunk_size) {
+            REQUIRE_FALSE(decoder.Done());
+            PushProgress progress =
+                decoder.Feed(data.data() + pos, std::min(chunk_size, data.size() - pos));
+            REQUIRE(progress.first_row == next_row);
+            REQUIRE(progress.bytes_consumed <= pos + chunk_size);
+            mismatches += CountMismatches(progress.rows.data(), expected.Width(),
+                                          progress.rows_count, expected, next_row);
+            next_row += progress.rows_count;
+        }
+        REQUIRE(decoder.Done());
+        REQUIRE(mismatches == 0);
+        REQUIRE(next_row == expected.Height());
+        REQUIRE(decoder.GetInfo().width == expected.Width());
+    }
+}
+
+TEST_CASE("partial image", "[partial]") {
+    std::ifstream fin(GetTestImagePath("lenna.jpg"));
+    std::string data((std::istreambuf_iterator<char>(fin)), std::istreambuf_iterator<char>());
+    std::string truncated = data.substr(0, data.size() / 2);
+
+    std::stringstream strict(truncated);
+    REQUIRE_THROWS(Decode(strict));
+
+    std::stringstream input(truncated);
+    DecodeOptions options;
+    options.allow_partial = true;
+    DecodeStatus status;
+    Image image = Decode(input, options, &status);
+    REQUIRE_FALSE(status.complete);
+    REQUIRE_FALSE(status.error.empty());
+    REQUIRE(image.Width() == 512);
+    REQUIRE(image.Height() == 512);
+    REQUIRE(status.rows_decoded > 0);
+    REQUIRE(status.rows_decoded < image.Height());
+    REQUIRE(image.GetPixel(511, 511).r == 128);
+    REQUIRE(image.GetPixel(511, 511).g == 128);
+
+    std::stringstream full(data);
+    Image expected = Decode(full);
+    for (size_t x = 0; x < image.Width(); ++x) {
+        REQUIRE(image.GetPixel(0, x).r == expected.GetPixel(0, x).r);
+    }
+}
+
+TEST_CASE("partial image of bad files", "[partial]") {
+    DecodeOptions options;
+    options.allow_partial = true;
+    // The scan is decoded to the end, but EOI is missing.
+    for (const char* filename : {"bad/bad14.jpg", "bad/bad21.jpg", "bad/bad24.jpg"}) {
+        std::ifstream fin(GetTestImagePath(filename));
+        DecodeStatus status;
+        Image image = Decode(fin, options, &status);
+        REQUIRE_FALSE(status.complete);
+        REQUIRE_FALSE(status.error.empty());
+        REQUIRE(status.rows_decoded > 0);
+        REQUIRE(status.rows_decoded == image.Height());
+    }
+    // The scan fails in the first row of MCUs on a missing table or a broken
+    // Huffman code, the image is all gray.
+    for (const char* filename :
+         {"bad/bad5.jpg", "bad/bad6.jpg", "bad/bad7.jpg", "bad/bad12.jpg", "bad/bad13.jpg"}) {
+        std::ifstream fin(GetTestImagePath(filename));
+        DecodeStatus status;
+        Image image = Decode(fin, options, &status);
+        REQUIRE_FALSE(status.complete);
+        REQUIRE_FALSE(status.error.empty());
+        REQUIRE(status.rows_decoded == 0);
+        REQUIRE(image.Height() > 0);
+    }
+    // The headers are broken, there is no image to return.
+    for (size_t i : {1, 2, 3, 4, 8, 9, 10, 11, 15, 16, 17, 18, 19, 20, 22, 23}) {
+        std::ifstream fin(GetTestImagePath("bad/bad" + std::to_string(i) + ".jpg"));
+        DecodeStatus status;
+        REQUIRE_THROWS(Decode(fin, options, &status));
+    }
+}
+
+TEST_CASE("region of interest", "[roi]") {
+    for (const char* filename : {"lenna.jpg", "chroma_halfed.jpg", "grayscale.jpg"}) {
+        std::ifstream full_in(GetTestImagePath(filename));
+        Image expected = Decode(full_in);
+
+        for (DecodeRegion roi : {DecodeRegion{0, 0, 10, 10}, DecodeRegion{37, 21, 100, 50},
+                                 DecodeRegion{300, 200, 1000, 1000}}) {
+            std::ifstream fin(GetTestImagePath(filename));
+            DecodeOptions options;
+            options.roi = roi;
+            Image image = Decode(fin, options);
+            REQUIRE(image.Width() == std::min(roi.width, expected.Width() - roi.x));
+            REQUIRE(image.Height() == std::min(roi.height, expected.Height() - roi.y));
+
+            REQUIRE(CountMismatches(image, expected, roi.y, roi.x) == 0);
+        }
+    }
+
+    std::ifstream fin(GetTestImagePath("small.jpg"));
+    DecodeOptions options;
+    options.roi = {32, 0, 1, 1};
+    REQUIRE_THROWS_AS(Decode(fin, options), std::invalid_argument);
+}
+
+TEST_CASE("coefficients", "[coefficients]") {
+    std::ifstream fin(GetTestImagePath("small.jpg"));
+    JpegCoefficients coefficients = DecodeCoefficients(fin);
+    REQUIRE(coefficients.info.width == 32);
+    REQUIRE(coefficients.components.size() == 3);
+    REQUIRE(coefficients.components[0].width_in_blocks == 4);
+    REQUIRE(coefficients.components[0].height_in_blocks == 4);
+    REQUIRE(coefficients.components[1].width_in_blocks == 2);
+    REQUIRE(coefficients.components[2].coefficients.size() == 2 * 2 * 64);
+
+    std::ifstream gray_in(GetTestImagePath("grayscale.jpg"));
+    coefficients = DecodeCoefficients(gray_in);
+    std::ifstream full_in(GetTestImagePath("grayscale.jpg"));
+    Image expected = Decode(full_in);
+
+    const ComponentCoefficients& luma = coefficients.components[0];
+    std::vector<double> input(64);
+    std::vector<double> output(64);
+    DctCalculator calculator(8, &input, &output);
+    for (auto [block_y, block_x] : {std::pair<size_t, size_t>{0, 0}, {10, 20}, {74, 74}}) {
+        const int16_t* block = luma.Block(block_y, block_x);
+        for (size_t i = 0; i < 64; ++i) {
+            input[i] = block[i] * luma.quant_table[i];
+        }
+        calculator.Inverse();
+        for (size_t i = 0; i < 64; ++i) {
+            int value = std::clamp(static_cast<int>(output[i] + 128), 0, 255);
+            RGB pixel = expected.GetPixel(block_y * 8 + i / 8, block_x * 8 + i % 8);
+            REQUIRE(std::abs(value - pixel.r) <= 1);
+        }
+    }
+}
+
+TEST_CASE("rendering coefficients", "[coefficients]") {
+    for (const char* filename : {"lenna.jpg", "chroma_halfed.jpg", "grayscale.jpg", "small.jpg"}) {
+        std::ifstream full_in(GetTestImagePath(filename));
+        Image expected = Decode(full_in);
+
+        std::ifstream fin(GetTestImagePath(filename));
+        DecodedCoefficients decoded(fin);
+        Image image = decoded.Render();
+        REQUIRE(image.Width() == expected.Width());
+        REQUIRE(image.Height() == expected.Height());
+        REQUIRE(CountMismatches(image, expected) == 0);
+
+        for (size_t scale : {2, 4, 8}) {
+            Image scaled = decoded.Render(scale);
+            REQUIRE(scaled.Width() == (expected.Width() + scale - 1) / scale);
+            REQUIRE(scaled.Height() == (expected.Height() + scale - 1) / scale);
+
+            double error = 0;
+            for (size_t y = 0; y < expected.Height() / scale; ++y) {
+                for (size_t x = 0; x < expected.Width() / scale; ++x) {
+                    double mean = 0;
+                    for (size_t i = 0; i < scale; ++i) {
+                        for (size_t j = 0; j < scale; ++j) {
+                            mean += expected.GetPixel(y * scale + i, x * scale + j).g;
+                        }
+                    }
+                    error += std::abs(mean / (scale * scale) - scaled.GetPixel(y, x).g);
+                }
+            }
+            error /= (expected.Height() / scale) * (expected.Width() / scale);
+            REQUIRE(error < 8);
+        }
+
+        Image region = decoded.Render(2, PixelFormat::kGrayscale, {5, 7, 40, 30});
+        Image full_gray = decoded.Render(2, PixelFormat::kGrayscale);
+        REQUIRE(region.Width() == std::min<size_t>(40, full_gray.Width() - 5));
+        size_t mismatches = 0;
+        for (size_t y = 0; y < region.Height(); ++y) {
+            for (size_t x = 0; x < region.Width(); ++x) {
+                const RGB& pixel = region.GetPixel(y, x);
+                mismatches += pixel.r != pixel.b || pixel.r != full_gray.GetPixel(y + 7, x + 5).r;
+            }
+        }
+        REQUIRE(mismatches == 0);
+    }
+}
+
+namespace {
+// Histogram of the EOB positions of the blocks, as BlockStats counts them.
+std::array<size_t, 65> EobPositions(const JpegCoefficients& coefficients) {
+    // Position of every coefficient of the block in the zigzag order.
+    std::array<size_t, 64> zigzag{};
+    size_t position = 0;
+    for (size_t diagonal = 0; diagonal < 15; ++diagonal) {
+        for (size_t i = 0; i <= diagonal; ++i) {
+            size_t row = diagonal % 2 ? i : diagonal - i;
+            size_t column = diagonal - row;
+            if (row < 8 && column < 8) {
+                zigzag[row * 8 + column] = position++;
+            }
+        }
+    }
+
+    std::array<size_t, 65> eob_positions{};
+    for (const ComponentCoefficients& component : coefficients.components) {
+        for (size_t offset = 0; offset < component.coefficients.size(); offset += 64) {
+            size_t last = 0;
+            for (size_t i = 1; i < 64; ++i) {
+                if (component.coefficients[offset + i] != 0) {
+                    last = std::max(last, zigzag[i]);
+                }
+            }
+            ++eob_positions[last == 63 ? 64 : last + 1];
+        }
+    }
+    return eob_positions;
+}
+}  // namespace
+
+TEST_CASE("block stats", "[coefficients]") {
+    BlockStats total;
+    size_t total_mcus = 0;
+    std::array<size_t, 65> total_eob_positions{};
+    for (const char* filename : {"small.jpg", "chroma_halfed.jpg", "grayscale.jpg", "lenna.jpg"}) {
+        std::ifstream fin(GetTestImagePath(filename));
+        JpegReader reader(fin);
+        BlockStats stats;
+        reader.SetBlockStats(&stats);
+        JpegCoefficients read;
+        REQUIRE(reader.ReadHeaders());
+        REQUIRE(reader.ReadCoefficients(read));
+
+        std::ifstream coefficients_in(GetTestImagePath(filename));
+        JpegCoefficients coefficients = DecodeCoefficients(coefficients_in);
+        const JpegInfo& info = coefficients.info;
+        // A single component is not interleaved, its MCUs are single blocks.
+        size_t max_horizontal = 1;
+        size_t max_vertical = 1;
+        size_t blocks_per_mcu = 1;
+        if (info.components.size() > 1) {
+            blocks_per_mcu = 0;
+            for (const JpegComponentInfo& component : info.components) {
+                max_horizontal = std::max<size_t>(max_horizontal, component.horizontal);
+                max_vertical = std::max<size_t>(max_vertical, component.vertical);
+                blocks_per_mcu += component.horizontal * component.vertical;
+            }
+        }
+        size_t mcus = (info.width + 8 * max_horizontal - 1) / (8 * max_horizontal) *
+                      ((info.height + 8 * max_vertical - 1) / (8 * max_vertical));
+        REQUIRE(stats.mcus == mcus);
+        REQUIRE(stats.blocks == mcus * blocks_per_mcu);
+
+        std::array<size_t, 65> eob_positions = EobPositions(coefficients);
+        REQUIRE(stats.eob_positions == eob_positions);
+        REQUIRE(stats.dc_only_blocks == eob_positions[1]);
+        REQUIRE(stats.dc_only_blocks < stats.blocks);
+        REQUIRE(stats.bits > 0);
+
+        total.Merge(stats);
+        total_mcus += mcus;
+        for (size_t i = 0; i < eob_positions.size(); ++i) {
+            total_eob_positions[i] += eob_positions[i];
+        }
+        REQUIRE(total.mcus == total_mcus);
+        REQUIRE(total.eob_positions == total_eob_positions);
+    }
+    size_t dc_only_blocks = total_eob_positions[1];
+    REQUIRE(total.dc_only_blocks == dc_only_blocks);
+}
+
+TEST_CASE("decoder reuse", "[context]") {
+    JpegDecoder decoder;
+    for (int round = 0; round < 2; ++round) {
+        for (const char* filename : {"tiny.jpg", "small.jpg", "grayscale.jpg", "chroma_halfed.jpg",
+                                     "lenna.jpg"}) {
+            std::ifstream full_in(GetTestImagePath(filename));
+            Image expected = Decode(full_in);
+
+            std::ifstream fin(GetTestImagePath(filename));
+            Image image = decoder.Decode(fin);
+            REQUIRE(image.Width() == expected.Width());
+            REQUIRE(image.Height() == expected.Height());
+            REQUIRE(image.GetComment() == expected.GetComment());
+            REQUIRE(CountMismatches(image, expected) == 0);
+        }
+
+        std::ifstream bad(GetTestImagePath("bad/bad5.jpg"));
+        REQUIRE_THROWS(decoder.Decode(bad));
+    }
+}
+
+TEST_CASE("stream of images", "[stream]") {
+    std::vector<const char*> filenames = {"small.jpg", "chroma_halfed.jpg", "grayscale.jpg",
+                                          "tiny.jpg", "small.jpg"};
+    std::string data;
+    for (const char* filename : filenames) {
+        std::ifstream fin(GetTestImagePath(filename));
+        data.append(std::istreambuf_iterator<char>(fin), std::istreambuf_iterator<char>());
+        data.append(3, '\0');
+    }
+
+    std::stringstream input(data);
+    JpegStreamDecoder decoder(input);
+    Image frame;
+    for (const char* filename : filenames) {
+        REQUIRE(decoder.Next(frame));
+
+        std::ifstream fin(GetTestImagePath(filename));
+        Image expected = Decode(fin);
+        REQUIRE(frame.Width() == expected.Width());
+        REQUIRE(frame.Height() == expected.Height());
+        REQUIRE(CountMismatches(frame, expected) == 0);
+    }
+    REQUIRE_FALSE(decoder.Next(frame));
+
+    std::stringstream broken(data.substr(0, data.size() - 100));
+    JpegStreamDecoder broken_decoder(broken);
+    for (size_t i = 0; i + 1 < filenames.size(); ++i) {
+        REQUIRE(broken_decoder.Next(frame));
+    }
+    REQUIRE_THROWS(broken_decoder.Next(frame));
+
+    // The options apply to every frame.
+    DecodeStats stats;
+    DecodeOptions options;
+    options.roi = {0, 1, 20, 20};
+    options.stats = &stats;
+    std::stringstream roi_input(data);
+    JpegStreamDecoder roi_decoder(roi_input, options);
+    DecodeOptions roi_only;
+    roi_only.roi = options.roi;
+    for (const char* filename : filenames) {
+        REQUIRE(roi_decoder.Next(frame));
+        std::ifstream fin(GetTestImagePath(filename));
+        Image expected = Decode(fin, roi_only);
+        REQUIRE(frame.Width() == expected.Width());
+        REQUIRE(frame.Height() == expected.Height());
+        REQUIRE(CountMismatches(frame, expected) == 0);
+    }
+    REQUIRE_FALSE(roi_decoder.Next(frame));
+#ifdef JPEG_DECODER_STATS
+    REQUIRE(stats.markers > 4 * filenames.size());
+#endif
+}
+
+namespace {
+// Moves the sections with the given markers from the headers of the image to
+// the tables-only stream.
+std::pair<std::string, std::string> SplitTables(const std::string& data,
+                                                const std::vector<uint8_t>& markers) {
+    std::string tables = "\xFF\xD8";
+    std::string image = data.substr(0, 2);
+    size_t pos = 2;
+    while (static_cast<uint8_t>(data[pos + 1]) != 0xDA) {
+        size_t length = (static_cast<uint8_t>(data[pos + 2]) << 8) |
+                        static_cast<uint8_t>(data[pos + 3]);
+        std::string section = data.substr(pos, length + 2);
+        uint8_t marker = data[pos + 1];
+        if (std::find(markers.begin(), markers.end(), marker) != markers.end()) {
+            tables += section;
+        } else {
+            image += section;
+        }
+        pos += length + 2;
+    }
+    image += data.substr(pos);
+    tables += "\xFF\xD9";
+    return {tables, image};
+}
+}  // namespace
+
+TEST_CASE("abbreviated images", "[tables]") {
+    for (const char* filename : {"small.jpg", "chroma_halfed.jpg", "grayscale.jpg"}) {
+        std::ifstream fin(GetTestImagePath(filename));
+        std::string data(std::istreambuf_iterator<char>(fin), {});
+        std::stringstream full_in(data);
+        Image expected = Decode(full_in);
+
+        auto [tables_data, image_data] = SplitTables(data, {0xDB, 0xC4});
+        std::stringstream tables_in(tables_data);
+        DecodeOptions options;
+        options.tables = LoadTables(tables_in);
+
+        std::stringstream missing_in(image_data);
+        REQUIRE_THROWS(Decode(missing_in));
+
+        JpegDecoder decoder;
+        for (int round = 0; round < 2; ++round) {
+            std::stringstream input(image_data);
+            Image image = decoder.Decode(input, options);
+            REQUIRE(image.Width() == expected.Width());
+            REQUIRE(image.Height() == expected.Height());
+            REQUIRE(CountMismatches(image, expected) == 0);
+        }
+    }
+
+    // The image is encoded with the standard Huffman tables, so it is decoded
+    // without its DHT sections.
+    std::ifstream fin(GetTestImagePath("chroma_halfed.jpg"));
+    std::string data(std::istreambuf_iterator<char>(fin), {});
+    std::stringstream full_in(data);
+    Image expected = Decode(full_in);
+    std::stringstream input(SplitTables(data, {0xC4}).second);
+    Image image = Decode(input);
+    REQUIRE(CountMismatches(image, expected) == 0);
+
+    std::stringstream not_tables("\xFF\xD8\xFF\xD9");
+    REQUIRE(LoadTables(not_tables));
+    std::ifstream image_in(GetTestImagePath("small.jpg"));
+    REQUIRE_THROWS(LoadTables(image_in));
+}
+
+TEST_CASE("concurrent decoding", "[threads]") {
+    std::vector<const char*> filenames = {"small.jpg", "chroma_halfed.jpg", "grayscale.jpg",
+                                          "tiny.jpg", "colors.jpg"};
+    std::vector<std::string> files;
+    std::vector<Image> expected;
+    for (const char* filename : filenames) {
+        std::ifstream fin(GetTestImagePath(filename));
+        files.emplace_back(std::istreambuf_iterator<char>(fin), std::istreambuf_iterator<char>());
+        std::stringstream input(files.back());
+        expected.push_back(Decode(input));
+    }
+
+    const size_t threads_count = 8;
+    std::vector<size_t> mismatches(threads_count);
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < threads_count; ++t) {
+        threads.emplace_back([&, t] {
+            JpegDecoder decoder;
+            for (size_t round = 0; round < 3; ++round) {
+                for (size_t i = 0; i < files.size(); ++i) {
+                    size_t file = (i + t) % files.size();
+                    std::stringstream input(files[file]);
+                    Image image = t % 2 ? decoder.Decode(input) : Decode(input);
+                    mismatches[t] += CountMismatches(image, expected[file]);
+                }
+            }
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    for (size_t t = 0; t < threads_count; ++t) {
+        REQUIRE(mismatches[t] == 0);
+    }
+}
+
+TEST_CASE("batch decoding", "[batch]") {
+    std::vector<const char*> filenames = {"small.jpg",     "chroma_halfed.jpg", "lenna.jpg",
+                                          "grayscale.jpg", "bad/bad5.jpg",      "tiny.jpg",
+                                          "colors.jpg"};
+    std::vector<std::string> files;
+    for (const char* filename : filenames) {
+        std::ifstream fin(GetTestImagePath(filename));
+        files.emplace_back(std::istreambuf_iterator<char>(fin), std::istreambuf_iterator<char>());
+    }
+
+    // Without limit, room for a few small images and for one image at a time.
+    for (auto [split_pixels, memory_budget] :
+         std::vector<std::pair<size_t, size_t>>{{size_t{1} << 30, 0},
+                                                 {1000, 0},
+                                                 {1000, 2'000'000},
+                                                 {1000, 1}}) {
+        DecodeOptions options;
+        options.roi = {5, 7, 1000, 1000};
+        BatchOptions batch_options;
+        batch_options.threads = 4;
+        batch_options.split_pixels = split_pixels;
+        batch_options.memory_budget = memory_budget;
+
+        std::vector<std::stringstream> streams;
+        std::vector<std::istream*> inputs;
+        for (const std::string& file : files) {
+            streams.emplace_back(file);
+        }
+        for (std::stringstream& stream : streams) {
+            inputs.push_back(&stream);
+        }
+
+        std::vector<BatchResult> results(files.size());
+        size_t callbacks = 0;
+        DecodeBatch(
+            inputs, options,
+            [&](BatchResult result) {
+                ++callbacks;
+                results[result.index] = std::move(result);
+            },
+            batch_options);
+        REQUIRE(callbacks == files.size());
+
+        for (size_t i = 0; i < files.size(); ++i) {
+            std::stringstream input(files[i]);
+            if (results[i].error) {
+                REQUIRE_THROWS(Decode(input, options));
+                continue;
+            }
+            Image expected = Decode(input, options);
+            const Image& image = results[i].image;
+            REQUIRE(image.Width() == expected.Width());
+            REQUIRE(image.Height() == expected.Height());
+            REQUIRE(results[i].status.rows_decoded == expected.Height());
+            REQUIRE(CountMismatches(image, expected) == 0);
+        }
+        REQUIRE(results[4].error);
+    }
+
+    // The exceptions of the callback don't stop the batch.
+    std::vector<std::stringstream> streams;
+    std::vector<std::istream*> inputs;
+    for (const std::string& file : files) {
+        streams.emplace_back(file);
+    }
+    for (std::stringstream& stream : streams) {
+        inputs.push_back(&stream);
+    }
+    std::atomic<size_t> callbacks = 0;
+    BatchOptions batch_options;
+    batch_options.threads = 4;
+    batch_options.split_pixels = 1000;
+    REQUIRE_THROWS_AS(DecodeBatch(
+                          inputs, {},
+                          [&](BatchResult) {
+                              ++callbacks;
+                              throw std::runtime_error("callback");
+                          },
+                          batch_options),
+                      std::runtime_error);
+    REQUIRE(callbacks == files.size());
+}
+
+TEST_CASE("limits", "[limits]") {
+    std::ifstream fin(GetTestImagePath("lenna.jpg"));
+    std::string data(std::istreambuf_iterator<char>(fin), {});
+    std::stringstream probe_in(data);
+    JpegInfo info = ProbeJpeg(probe_in);
+
+    auto decode = [&data](const DecodeLimits& limits) {
+        DecodeOptions options;
+        options.limits = limits;
+        std::stringstream input(data);
+        return Decode(input, options);
+    };
+
+    DecodeLimits limits;
+    limits.max_dimension = std::max(info.width, info.height);
+    limits.max_pixels = info.width * info.height;
+    limits.max_pixels_per_input_byte = 100;
+    limits.max_memory = 2 * info.width * info.height * sizeof(RGB);
+    REQUIRE(decode(limits).Width() == info.width);
+
+    DecodeLimits dimension = limits;
+    --dimension.max_dimension;
+    REQUIRE_THROWS_AS(decode(dimension), std::invalid_argument);
+    DecodeLimits pixels = limits;
+    --pixels.max_pixels;
+    REQUIRE_THROWS_AS(decode(pixels), std::invalid_argument);
+    DecodeLimits memory = limits;
+    memory.max_memory = info.width * info.height * sizeof(RGB);
+    REQUIRE_THROWS_AS(decode(memory), std::invalid_argument);
+
+    // Room for the image, but not for the coefficients the split decoding
+    // holds as well.
+    for (auto [split_pixels, fits] :
+         std::vector<std::pair<size_t, bool>>{{size_t{1} << 30, true}, {1000, false}}) {
+        DecodeOptions options;
+        options.limits.max_memory = info.width * info.height * (sizeof(RGB) + 4);
+        BatchOptions batch_options;
+        batch_options.split_pixels = split_pixels;
+        std::stringstream input(data);
+        BatchResult result;
+        DecodeBatch({&input}, options, [&result](BatchResult r) { result = std::move(r); },
+                    batch_options);
+        if (fits) {
+            REQUIRE_FALSE(result.error);
+        } else {
+            REQUIRE(result.error);
+            REQUIRE_THROWS_WITH(std::rethrow_exception(result.error),
+                                "Image needs more memory than the limit");
+        }
+    }
+
+    // The header of a huge image followed by a few bytes of the scan.
+    std::string header = data.substr(0, data.find("\xFF\xDA") + 64);
+    header[data.find("\xFF\xC0") + 5] = '\xFF';
+    header[data.find("\xFF\xC0") + 7] = '\xFF';
+    DecodeOptions options;
+    options.limits.max_pixels_per_input_byte = 100;
+    std::stringstream input(header);
+    REQUIRE_THROWS_WITH(Decode(input, options), "Image has too many pixels for the input size");
+}
+
+TEST_CASE("decoding without exceptions", "[result]") {
+    for (const char* filename : {"small.jpg", "lenna.jpg", "grayscale.jpg"}) {
+        std::ifstream expected_in(GetTestImagePath(filename));
+        Image expected = Decode(expected_in);
+        std::ifstream fin(GetTestImagePath(filename));
+        Result<Image, DecodeError> result = TryDecode(fin);
+        REQUIRE(result.IsOk());
+        REQUIRE(result.Value().Width() == expected.Width());
+        REQUIRE(result.Value().Height() == expected.Height());
+        REQUIRE(result.Value().GetPixel(10, 10).g == expected.GetPixel(10, 10).g);
+    }
+
+    for (int i = 1; i <= 24; ++i) {
+        std::ifstream fin(GetTestImagePath("bad/bad" + std::to_string(i) + ".jpg"));
+        REQUIRE(fin);
+        REQUIRE_FALSE(TryDecode(fin).IsOk());
+    }
+
+    std::stringstream junk("GIF89a and some junk");
+    Result<Image, DecodeError> junk_result = TryDecode(junk);
+    REQUIRE_FALSE(junk_result);
+    REQUIRE(junk_result.Error().code == DecodeErrorCode::kNotJpeg);
+    REQUIRE(junk_result.Error().offset == 0);
+
+    std::ifstream fin(GetTestImagePath("small.jpg"));
+    std::string data(std::istreambuf_iterator<char>(fin), {});
+    std::stringstream truncated(data.substr(0, 40));
+    REQUIRE(TryDecode(truncated).Error().code == DecodeErrorCode::kTruncated);
+    std::stringstream truncated_scan(data.substr(0, data.size() - 100));
+    REQUIRE(TryDecode(truncated_scan).Error().code == DecodeErrorCode::kTruncated);
+
+    // Ones only are not a Huffman code.
+    std::string corrupted_scan = data;
+    size_t scan = data.find("\xFF\xDA") + 2 + 12;
+    std::fill(corrupted_scan.begin() + scan, corrupted_scan.begin() + scan + 16, '\xFF');
+    std::stringstream corrupted_in(corrupted_scan);
+    Result<Image, DecodeError> corrupted_result = TryDecode(corrupted_in);
+    REQUIRE(corrupted_result.Error().code == DecodeErrorCode::kInvalidScan);
+    REQUIRE(corrupted_result.Error().offset > scan);
+    REQUIRE(corrupted_result.Error().offset <= scan + 16);
+
+    std::string progressive = data;
+    progressive[progressive.find("\xFF\xC0") + 1] = '\xC2';
+    std::stringstream progressive_in(progressive);
+    Result<Image, DecodeError> progressive_result = TryDecode(progressive_in);
+    REQUIRE(progressive_result.Error().code == DecodeErrorCode::kUnsupported);
+    REQUIRE(progressive_result.Error().offset == data.find("\xFF\xC0"));
+}
+
+TEST_CASE("decode stats", "[stats]") {
+    std::ifstream fin(GetTestImagePath("chroma_halfed.jpg"));
+    std::string data(std::istreambuf_iterator<char>(fin), {});
+    DecodeStats stats;
+    DecodeOptions options;
+    options.stats = &stats;
+    std::stringstream input(data);
+    Image image = Decode(input, options);
+
+#ifdef JPEG_DECODER_STATS
+    std::stringstream probe_in(data);
+    JpegInfo info = ProbeJpeg(probe_in);
+    size_t max_h = 0;
+    size_t max_v = 0;
+    size_t mcu_blocks = 0;
+    for (const JpegComponentInfo& component : info.components) {
+        max_h = std::max<size_t>(max_h, component.horizontal);
+        max_v = std::max<size_t>(max_v, component.vertical);
+        mcu_blocks += component.horizontal * component.vertical;
+    }
+    size_t mcus = ((info.width + 8 * max_h - 1) / (8 * max_h)) *
+                  ((info.height + 8 * max_v - 1) / (8 * max_v));
+    REQUIRE(stats.mcus == mcus);
+    REQUIRE(stats.blocks == mcu_blocks * mcus);
+    REQUIRE(stats.bytes_consumed + 4 > data.size());
+    REQUIRE(stats.bytes_consumed <= data.size());
+    REQUIRE(stats.markers > 4);
+    REQUIRE(stats.header_ns > 0);
+    REQUIRE(stats.entropy_ns > 0);
+    REQUIRE(stats.idct_ns > 0);
+    REQUIRE(stats.color_ns > 0);
+    REQUIRE(stats.output_ns > 0);
+    REQUIRE(stats.allocations > image.Height());
+#else
+    REQUIRE(stats.mcus == 0);
+#endif
+}
+
+TEST_CASE("perf counters", "[stats]") {
+    std::ifstream fin(GetTestImagePath("chroma_halfed.jpg"));
+    DecodeStats stats;
+    DecodeOptions options;
+    options.stats = &stats;
+    options.perf_counters = true;
+    Decode(fin, options);
+
+    // The counters stay zero where perf events are not permitted.
+    if (stats.entropy_perf.cycles == 0) {
+        REQUIRE(stats.idct_perf.cycles == 0);
+        return;
+    }
+    for (const PerfCounters* perf : {&stats.header_perf, &stats.entropy_perf, &stats.idct_perf,
+                                     &stats.color_perf, &stats.output_perf}) {
+        REQUIRE(perf->cycles > 0);
+        REQUIRE(perf->instructions > 0);
+    }
+    REQUIRE(stats.entropy_ns > 0);
+}
+
+TEST_CASE("steady state allocations", "[allocations]") {
+    std::ifstream fin(GetTestImagePath("chroma_halfed.jpg"));
+    std::string data(std::istreambuf_iterator<char>(fin), {});
+    JpegDecoder decoder;
+    DecodeStats stats;
+    DecodeOptions options;
+    options.stats = &stats;
+    for (size_t i = 0; i < 2; ++i) {
+        std::stringstream input(data);
+        decoder.Decode(input, options);
+    }
+
+    stats = {};
+    std::stringstream input(data);
+    Image image = decoder.Decode(input, options);
+    REQUIRE(image.Height() > 0);
+#ifdef JPEG_DECODER_STATS
+    // The rows, the row they are copied from and the vector of them, nothing
+    // per MCU.
+    REQUIRE(stats.allocations == image.Height() + 2);
+    REQUIRE(stats.mcus > 256);
+    REQUIRE(stats.peak_bytes >= image.Width() * image.Height() * sizeof(RGB));
+#endif
+}
+
+TEST_CASE("tiny images", "[allocations]") {
+    std::ifstream fin(GetTestImagePath("tiny.jpg"));
+    std::string data(std::istreambuf_iterator<char>(fin), {});
+    DecodeStats stats;
+    DecodeOptions options;
+    options.stats = &stats;
+    for (size_t i = 0; i < 2; ++i) {
+        std::stringstream input(data);
+        Decode(input, options);
+    }
+
+    stats = {};
+    std::stringstream input(data);
+    Image image = Decode(input, options);
+    REQUIRE(image.Height() > 0);
+#ifdef JPEG_DECODER_STATS
+    // Only the rows of the image, the reader of the thread keeps the rest.
+    REQUIRE(stats.allocations == image.Height() + 2);
+#endif
+}
+
+TEST_CASE("memory resource", "[allocations]") {
+    std::ifstream fin(GetTestImagePath("chroma_halfed.jpg"));
+    std::string data(std::istreambuf_iterator<char>(fin), {});
+    std::stringstream expected_in(data);
+    Image expected = Decode(expected_in);
+
+    auto check = [&expected](const Image& image) {
+        REQUIRE(image.Width() == expected.Width());
+        REQUIRE(image.Height() == expected.Height());
+        REQUIRE(CountMismatches(image, expected) == 0);
+    };
+
+    SECTION("arena") {
+        std::stringstream probe_in(data);
+        JpegInfo info = ProbeJpeg(probe_in);
+        // The arena takes its memory from the default resource when it is made.
+        CountingUpstream upstream;
+        std::pmr::memory_resource* previous = std::pmr::set_default_resource(&upstream);
+        DecodeArena arena(info);
+        std::pmr::set_default_resource(previous);
+        DecodeOptions options;
+        options.memory_resource = arena.Resource();
+        std::stringstream input(data);
+        Image image = Decode(input, options);
+        // The image and the buffers fit into the first block of the arena.
+        REQUIRE(upstream.Count() == 1);
+        REQUIRE(arena.InitialSize() > image.Width() * image.Height() * sizeof(RGB));
+        check(image);
+    }
+
+    SECTION("reused decoder") {
+        JpegDecoder decoder;
+        for (size_t i = 0; i < 2; ++i) {
+            std::pmr::monotonic_buffer_resource resource;
+            DecodeOptions options;
+            options.memory_resource = &resource;
+            std::stringstream input(data);
+            check(decoder.Decode(input, options));
+        }
+        std::stringstream input(data);
+        check(decoder.Decode(input));
+    }
+}
+
+namespace {
+// Value of |key| in the JSON object on |line|, without the quotes.
+std::string JsonField(const std::string& line, const std::string& key) {
+    size_t pos = line.find("\"" + key + "\":");
+    if (pos == std::string::npos) {
+        return "";
+    }
+    pos += key.size() + 3;
+    if (line[pos] == '"') {
+        ++pos;
+        return line.substr(pos, line.find('"', pos) - pos);
+    }
+    return line.substr(pos, line.find_first_of(",}", pos) - pos);
+}
+}  // namespace
+
+TEST_CASE("trace export", "[trace]") {
+    std::ifstream fin(GetTestImagePath("chroma_halfed.jpg"));
+    std::string data(std::istreambuf_iterator<char>(fin), {});
+
+    StartTracing();
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < 2; ++i) {
+        threads.emplace_back([&data] {
+            std::stringstream input(data);
+            Decode(input);
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    std::stringstream out;
+    StopTracing(out);
+
+    std::string json = out.str();
+    REQUIRE(json.rfind("{\"traceEvents\":[\n", 0) == 0);
+    REQUIRE(json.find("\n],\"displayTimeUnit\":\"ms\"}") != std::string::npos);
+
+    // An event per line: the names of the threads and the spans they recorded.
+    std::set<std::string> threads_named;
+    std::map<std::string, std::multiset<std::string>> spans;
+    std::istringstream lines(json);
+    std::string line;
+    std::getline(lines, line);
+    while (std::getline(lines, line) && line.front() == '{') {
+        std::string tid = JsonField(line, "tid");
+        std::string phase = JsonField(line, "ph");
+        REQUIRE(JsonField(line, "pid") == "1");
+        if (phase == "M") {
+            REQUIRE(JsonField(line, "name") == "thread_name");
+            REQUIRE(threads_named.insert(tid).second);
+        } else {
+            REQUIRE(phase == "X");
+            REQUIRE(std::stod(JsonField(line, "ts")) >= 0);
+            REQUIRE(std::stod(JsonField(line, "dur")) >= 0);
+            spans[tid].insert(JsonField(line, "name"));
+        }
+    }
+    REQUIRE(line == "],\"displayTimeUnit\":\"ms\"}");
+
+    // Only the two decoding threads, each with one image and all its stages.
+    REQUIRE(threads_named.size() == 2);
+    REQUIRE(spans.size() == 2);
+    for (const std::string& tid : threads_named) {
+        REQUIRE(spans[tid].count("decode") == 1);
+        REQUIRE(spans[tid].count("headers") == 1);
+        for (const char* name : {"scan", "entropy", "idct", "color", "output"}) {
+            REQUIRE(spans[tid].count(name) > 0);
+        }
+    }
+
+    // Nothing is recorded once the tracing is stopped.
+    std::stringstream input(data);
+    Decode(input);
+    std::stringstream empty;
+    StopTracing(empty);
+    REQUIRE(empty.str().find("\"ph\":\"X\"") == std::string::npos);
+}
@@ -2,6 +2,7 @@
 
 #include <vector>
 #include <cstddef>
+#include <memory_resource>
 #include <string>
 
 struct RGB {
@@ -15,9 +16,12 @@ public:
     Image(size_t width, size_t height) {
         SetSize(width, height);
     }
+    // The pixels are allocated from |resource|, which has to outlive the image.
+    explicit Image(std::pmr::memory_resource* resource) : data_(resource) {
+    }
 
     void SetSize(size_t width, size_t height) {
-        data_.assign(height, std::vector<RGB>(width));
+        data_.assign(height, std::pmr::vector<RGB>(width, data_.get_allocator()));
     }
 
     size_t Width() const {
@@ -52,6 +56,6 @@ public:
     }
 
 private:
-    std::vector<std::vector<RGB>> data_;
+    std::pmr::vector<std::pmr::vector<RGB>> data_;
     std::string comment_;
 };
@@ -86,3 +86,7 @@ void ExpectFail(const std::string& filename) {
     }
     CHECK_THROWS(Decode(fin));
 }
+
+std::string GetTestImagePath(const std::string& filename) {
+    return kBasePath + "tests/" + filename;
+}